@@ -1,5 +1,62 @@
+#ifndef _TINY_FAMILY_SLEEPY_H_
+#define _TINY_FAMILY_SLEEPY_H_
+
 #include <stdint.h>
 #include <memory.h>
+#include <math.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include "TinyTool.h"
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                                 SIZETYPE                                  */
+/*       Counts of bits and ring slots, 32-bit by default for MCU builds.    */
+/*  Define TINY_LARGE_CAPACITY for bit fields beyond 4G bits and rings       */
+/*  beyond 4G slots.                                                         */
+/*                                                                           */
+/*****************************************************************************/
+
+#if defined(TINY_LARGE_CAPACITY)
+#define SIZETYPE uint64_t
+static_assert(sizeof(size_t) >= sizeof(uint64_t), "TINY_LARGE_CAPACITY needs a 64-bit size_t for the memory functions.");
+#else
+#define SIZETYPE uint32_t
+#endif
+
+// Keeps a rare slow path out of the hot loop it is called from.
+#if defined(_MSC_VER)
+#define TINY_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define TINY_NOINLINE __attribute__((noinline))
+#else
+#define TINY_NOINLINE
+#endif
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                               TINY_THREADS                                */
+/*  Define TINY_THREADS for TinyThreadPool, the parallel BitField ops and    */
+/*  the timed ring put/get. Left out by default, so the ring shells and      */
+/*  bit fields build on toolchains that have no std::thread.                 */
+/*                                                                           */
+/*****************************************************************************/
+
+#if defined(TINY_THREADS)
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#define TINY_YIELD() std::this_thread::yield()
+#else
+#define TINY_YIELD() ((void)0)
+#endif
 
 
 /*****************************************************************************/
@@ -39,6 +96,101 @@ protected:
 ******************************************************************************/
 
 
+/*****************************************************************************/
+/*                                                                           */
+/*                            struct TinySpanPair                            */
+/*    A ring region is contiguous or split in two at the end of the buffer.  */
+/*                                                                           */
+/*****************************************************************************/
+
+template< class T >
+struct TinySpan
+{
+    T* data;
+    SIZETYPE length;
+};
+
+template< class T >
+struct TinySpanPair
+{
+    TinySpan< T > first;
+    TinySpan< T > second;
+
+    SIZETYPE length() const { return first.length + second.length; }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                  struct TinyModuloIndex / TinyStaticIndex                 */
+/*            Index policies that map a ring position to a buffer slot.      */
+/*  TinyStaticIndex knows the length at compile time: a power of two SIZE    */
+/*  becomes a mask, any other SIZE a division by a constant.                 */
+/*                                                                           */
+/*****************************************************************************/
+
+struct TinyModuloIndex
+{
+    static SIZETYPE slot(uint64_t pos, SIZETYPE length) { return (SIZETYPE)(pos % length); }
+};
+
+template< uint32_t SIZE, bool POWER_OF_TWO = ((SIZE & (SIZE - 1)) == 0) >
+struct TinyStaticIndex
+{
+    static SIZETYPE slot(uint64_t pos, SIZETYPE) { return (SIZETYPE)(pos % SIZE); }
+};
+
+template< uint32_t SIZE >
+struct TinyStaticIndex< SIZE, true >
+{
+    static SIZETYPE slot(uint64_t pos, SIZETYPE) { return (SIZETYPE)(pos & (SIZE - 1)); }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                enum TinyRingPolicy / struct TinyRingStats                 */
+/* What a put does on a full ring, and counters to size rings from traffic.  */
+/*  OVERWRITE drops the oldest entries, REJECT refuses the new ones, BLOCK   */
+/*  waits for space, which only a ring shared between threads can make.      */
+/*                                                                           */
+/*****************************************************************************/
+
+enum TinyRingPolicy
+{
+    TINY_RING_OVERWRITE = 0,
+    TINY_RING_REJECT = 1,
+    TINY_RING_BLOCK = 2,
+};
+
+struct TinyRingStats
+{
+    uint64_t dropped;       // Entries lost to OVERWRITE
+    uint64_t rejected;      // Entries refused by a full ring, each refused attempt counts
+    uint64_t highWater;     // Largest length seen
+    uint64_t totalIn;       // Entries written
+    uint64_t totalOut;      // Entries read or released
+
+    TinyRingStats() : dropped(0), rejected(0), highWater(0), totalIn(0), totalOut(0) { }
+};
+
+#if defined(TINY_THREADS)
+struct TinyRingWait
+{
+    // Retries attempt() with yield until it succeeds or timeoutMs passes, negative waits forever.
+    template< class TRY >
+    static bool until(TRY attempt, int32_t timeoutMs) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (!attempt()) {
+            if ((timeoutMs >= 0) && (std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(timeoutMs))) { return false; }
+            TINY_YIELD();
+        }
+        return true;
+    }
+};
+#endif
+
+
 /*****************************************************************************/
 /*                                                                           */
 /*                           class RingBufferShell                           */
@@ -46,42 +198,87 @@ protected:
 /*                                                                           */
 /*****************************************************************************/
 
-template< class T >
+template< class T, class INDEX = TinyModuloIndex >
 class TinyRingBufferShell
 {
 protected:
     T* m_buffer;
-    uint32_t m_length;
+    SIZETYPE m_length;
     uint64_t* m_readPos;
     uint64_t* m_writePos;
-    uint32_t m_threshold;
+    uint64_t m_threshold;
+    TinyRingPolicy m_policy;
+    TinyRingStats m_stats;
 
 public:
-    TinyRingBufferShell() : m_buffer(NULL), m_length(0), m_readPos(NULL), m_writePos(NULL) { }
+    TinyRingBufferShell() : m_buffer(NULL), m_length(0), m_readPos(NULL), m_writePos(NULL), m_policy(TINY_RING_OVERWRITE) { }
     virtual ~TinyRingBufferShell() { };
 
-    void init(T* buffer, uint32_t length, uint64_t* readPos, uint64_t* writePos, uint32_t threshold = 0) {
+    void init(T* buffer, SIZETYPE length, uint64_t* readPos, uint64_t* writePos, uint64_t threshold = 0) {
         m_buffer = buffer; m_length = length; m_readPos = readPos; m_writePos = writePos; m_threshold = threshold;
     }
     bool inited() const { return (m_buffer != NULL) && (m_length > 0) && (m_readPos != NULL) && (m_writePos != NULL); };
 
-    uint32_t length() { adjust();  return (uint32_t)((*m_writePos) - (*m_readPos)); };
-    uint32_t capacity() const { return m_length; };
+    SIZETYPE length() { adjust();  return (SIZETYPE)((*m_writePos) - (*m_readPos)); };
+    SIZETYPE capacity() const { return m_length; };
+
+    // Nothing else can drain this ring while a put waits, so TINY_RING_BLOCK refuses like TINY_RING_REJECT.
+    void setPolicy(TinyRingPolicy policy) { m_policy = policy; }
+    TinyRingPolicy policy() const { return m_policy; }
+    const TinyRingStats& stats() const { return m_stats; }
+    void resetStats() { m_stats = TinyRingStats(); }
 
     bool end() const { return (*m_readPos) >= (*m_writePos); }
-    void put(const T& val) { m_buffer[((*m_writePos)++) % m_length] = val; }
+    bool put(const T& val) {
+        if (admit(1) == 0) { return false; }
+        m_buffer[INDEX::slot((*m_writePos)++, m_length)] = val;
+        settle(1);
+        return true;
+    }
     void poke(int32_t offset, const T& val) { access((*m_writePos) + offset) = val; }
-    T get() { return adjust() && readable(*m_readPos) ? access((*m_readPos)++) : T(); }
+    T get() {
+        if (!(adjust() && readable(*m_readPos))) { return T(); }
+        ++m_stats.totalOut;
+        return access((*m_readPos)++);
+    }
     T peek(int32_t offset) { adjust();  uint64_t pos((*m_readPos) + offset); return readable(pos) ? access(pos) : T(); };
 
+    // Zero-copy access: fill the reserved spans then commit, or consume the acquired spans then release.
+    // Only free space can be reserved, so a reservation never overlaps the readable data.
+    TinySpanPair< T > reserveWrite(SIZETYPE n) { SIZETYPE space = m_length - length(); return spans(*m_writePos, (n < space) ? n : space); }
+    void commitWrite(SIZETYPE n) { SIZETYPE space = m_length - length(); n = (n < space) ? n : space; (*m_writePos) += n; settle(n); }
+    TinySpanPair< T > acquireRead() { return spans(*m_readPos, length()); }
+    void releaseRead(SIZETYPE n) { SIZETYPE len = length(); n = (n < len) ? n : len; (*m_readPos) += n; m_stats.totalOut += n; }
+
 protected:
-    T& access(uint64_t pos) { return m_buffer[pos % m_length]; };
+    T& access(uint64_t pos) { return m_buffer[INDEX::slot(pos, m_length)]; };
+    TinySpanPair< T > spans(uint64_t pos, SIZETYPE len) const {
+        SIZETYPE offset = INDEX::slot(pos, m_length);
+        SIZETYPE first = (len < m_length - offset) ? len : (m_length - offset);
+        TinySpanPair< T > pair = { { m_buffer + offset, first }, { m_buffer, len - first } };
+        return pair;
+    }
     bool readable(uint64_t pos) { return (pos < (*m_writePos)); };
     bool adjust() {
         if (((*m_writePos) - (*m_readPos) > m_length)) { (*m_readPos) = (*m_writePos) - m_length; }
         if ((m_threshold > 0) && ((*m_readPos) > m_threshold)) { (*m_writePos) -= m_threshold; (*m_readPos) -= m_threshold; };
         return true;
     }
+    // How many of n new entries may be written. Only OVERWRITE takes more than the free space.
+    SIZETYPE admit(SIZETYPE n) {
+        uint64_t used = (*m_writePos) - (*m_readPos);
+        SIZETYPE space = (used < m_length) ? (SIZETYPE)(m_length - used) : 0;
+        if ((n <= space) || (m_policy == TINY_RING_OVERWRITE)) { return n; }
+        m_stats.rejected += n - space;
+        return space;
+    }
+    // After n entries were written: drop what they overwrote and update the counters.
+    void settle(SIZETYPE n) {
+        uint64_t used = (*m_writePos) - (*m_readPos);
+        if (used > m_length) { m_stats.dropped += used - m_length; (*m_readPos) = (*m_writePos) - m_length; used = m_length; }
+        if (used > m_stats.highWater) { m_stats.highWater = used; }
+        m_stats.totalIn += n;
+    }
 };
 
 
@@ -93,7 +290,7 @@ protected:
 /*****************************************************************************/
 
 template< class T, uint32_t SIZE >
-class TinyRingBuffer : public TinyRingBufferShell< T >
+class TinyRingBuffer : public TinyRingBufferShell< T, TinyStaticIndex< SIZE > >
 {
 protected:
     T m_data[SIZE];
@@ -103,12 +300,309 @@ protected:
 public:
     TinyRingBuffer() : m_rPos(0), m_wPos(0) {
         for (uint32_t i = 0; i < SIZE; i++) { m_data[i] = T(); }
-        init(m_data, SIZE, &m_rPos, &m_wPos);
+        this->init(m_data, SIZE, &m_rPos, &m_wPos);
     }
     virtual ~TinyRingBuffer() { };
 };
 
 
+/*****************************************************************************/
+/*                                                                           */
+/*                       class TinySpscRingBufferShell                       */
+/*         Lock-free ring buffer for ONE producer and ONE consumer.          */
+/*  The cursors are external like TinyRingBufferShell, so they can be put    */
+/*  in any memory that both sides can see. Each cursor has its own cache     */
+/*  line and is only written by its owner. Never overwrites: put() fails     */
+/*  when the buffer is full, put(val, timeoutMs) waits for space instead     */
+/*  (TINY_THREADS). Counters live with the side that updates them,           */
+/*  highWater is measured against the producer's cached read cursor, so it   */
+/*  may run a little high.                                                   */
+/*                                                                           */
+/*****************************************************************************/
+
+#define TINY_CACHE_LINE_SIZE 64
+
+struct TinySpscCursors
+{
+    alignas(TINY_CACHE_LINE_SIZE) std::atomic< uint64_t > writePos;     // Written by producer only
+    alignas(TINY_CACHE_LINE_SIZE) std::atomic< uint64_t > readPos;      // Written by consumer only
+
+    TinySpscCursors() : writePos(0), readPos(0) { }
+};
+
+template< class T, class INDEX = TinyModuloIndex >
+class TinySpscRingBufferShell
+{
+protected:
+    T* m_buffer;
+    SIZETYPE m_length;
+    TinySpscCursors* m_cursors;
+    alignas(TINY_CACHE_LINE_SIZE) uint64_t m_cachedReadPos;     // Producer's copy of readPos
+    std::atomic< uint64_t > m_rejected, m_highWater, m_totalIn;  // Written by producer only
+    alignas(TINY_CACHE_LINE_SIZE) uint64_t m_cachedWritePos;    // Consumer's copy of writePos
+    std::atomic< uint64_t > m_totalOut;                          // Written by consumer only
+
+public:
+    TinySpscRingBufferShell() : m_buffer(NULL), m_length(0), m_cursors(NULL), m_cachedReadPos(0),
+        m_rejected(0), m_highWater(0), m_totalIn(0), m_cachedWritePos(0), m_totalOut(0) { }
+    virtual ~TinySpscRingBufferShell() { };
+
+    void init(T* buffer, SIZETYPE length, TinySpscCursors* cursors) {
+        m_buffer = buffer; m_length = length; m_cursors = cursors;
+        m_cachedReadPos = cursors->readPos.load(std::memory_order_acquire);
+        m_cachedWritePos = cursors->writePos.load(std::memory_order_acquire);
+    }
+    bool inited() const { return (m_buffer != NULL) && (m_length > 0) && (m_cursors != NULL); };
+
+    SIZETYPE length() const {
+        uint64_t rPos = m_cursors->readPos.load(std::memory_order_acquire);
+        return (SIZETYPE)(m_cursors->writePos.load(std::memory_order_acquire) - rPos);
+    }
+    SIZETYPE capacity() const { return m_length; };
+
+    TinyRingStats stats() const {
+        TinyRingStats stats;
+        stats.rejected = m_rejected.load(std::memory_order_relaxed);
+        stats.highWater = m_highWater.load(std::memory_order_relaxed);
+        stats.totalIn = m_totalIn.load(std::memory_order_relaxed);
+        stats.totalOut = m_totalOut.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // Consumer side
+    bool end() { return !readable(m_cursors->readPos.load(std::memory_order_relaxed)); }
+    T get() { T val = T(); get(val); return val; }
+    bool get(T& val) {
+        uint64_t rPos = m_cursors->readPos.load(std::memory_order_relaxed);
+        if (!readable(rPos)) { return false; }
+        val = m_buffer[INDEX::slot(rPos, m_length)];
+        m_cursors->readPos.store(rPos + 1, std::memory_order_release);
+        count(m_totalOut, 1);
+        return true;
+    }
+#if defined(TINY_THREADS)
+    bool get(T& val, int32_t timeoutMs) { return TinyRingWait::until([&]() { return get(val); }, timeoutMs); }
+#endif
+
+    // Producer side
+    bool full() { return !writable(m_cursors->writePos.load(std::memory_order_relaxed)); }
+    bool put(const T& val) {
+        if (offer(val)) { return true; }
+        count(m_rejected, 1);
+        return false;
+    }
+#if defined(TINY_THREADS)
+    bool put(const T& val, int32_t timeoutMs) {
+        if (TinyRingWait::until([&]() { return offer(val); }, timeoutMs)) { return true; }
+        count(m_rejected, 1);
+        return false;
+    }
+#endif
+
+    // Bulk versions: copy as much as fits or as is there, and move the cursor once.
+    // What does not fit counts as rejected, the same as a failed put() per element.
+    SIZETYPE write(const T* data, SIZETYPE n) {
+        SIZETYPE done = offer(data, n);
+        if (done < n) { count(m_rejected, n - done); }
+        return done;
+    }
+    SIZETYPE read(T* data, SIZETYPE n) {
+        uint64_t rPos = m_cursors->readPos.load(std::memory_order_relaxed);
+        if (rPos + n > m_cachedWritePos) { m_cachedWritePos = m_cursors->writePos.load(std::memory_order_acquire); }
+        SIZETYPE available = (SIZETYPE)(m_cachedWritePos - rPos);
+        if (n > available) { n = available; }
+        SIZETYPE offset = INDEX::slot(rPos, m_length);
+        SIZETYPE first = (n < m_length - offset) ? n : (m_length - offset);
+        std::copy(m_buffer + offset, m_buffer + offset + first, data);
+        std::copy(m_buffer, m_buffer + (n - first), data + first);
+        m_cursors->readPos.store(rPos + n, std::memory_order_release);
+        count(m_totalOut, n);
+        return n;
+    }
+
+protected:
+    bool offer(const T& val) {
+        uint64_t wPos = m_cursors->writePos.load(std::memory_order_relaxed);
+        if (!writable(wPos)) { return false; }
+        m_buffer[INDEX::slot(wPos, m_length)] = val;
+        m_cursors->writePos.store(wPos + 1, std::memory_order_release);
+        written(wPos + 1, 1);
+        return true;
+    }
+    SIZETYPE offer(const T* data, SIZETYPE n) {
+        uint64_t wPos = m_cursors->writePos.load(std::memory_order_relaxed);
+        if (wPos - m_cachedReadPos + n > m_length) { m_cachedReadPos = m_cursors->readPos.load(std::memory_order_acquire); }
+        SIZETYPE space = m_length - (SIZETYPE)(wPos - m_cachedReadPos);
+        if (n > space) { n = space; }
+        SIZETYPE offset = INDEX::slot(wPos, m_length);
+        SIZETYPE first = (n < m_length - offset) ? n : (m_length - offset);
+        std::copy(data, data + first, m_buffer + offset);
+        std::copy(data + first, data + n, m_buffer);
+        m_cursors->writePos.store(wPos + n, std::memory_order_release);
+        written(wPos + n, n);
+        return n;
+    }
+    // Single writer counters: a plain add, atomic only so stats() may read them from any thread.
+    static void count(std::atomic< uint64_t >& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void written(uint64_t wPos, SIZETYPE n) {
+        count(m_totalIn, n);
+        if (wPos - m_cachedReadPos > m_highWater.load(std::memory_order_relaxed)) {
+            m_highWater.store(wPos - m_cachedReadPos, std::memory_order_relaxed);
+        }
+    }
+    // Only touch the shared cursor when the cached copy says we must.
+    bool readable(uint64_t rPos) {
+        if (rPos < m_cachedWritePos) { return true; }
+        m_cachedWritePos = m_cursors->writePos.load(std::memory_order_acquire);
+        return rPos < m_cachedWritePos;
+    }
+    bool writable(uint64_t wPos) {
+        if (wPos - m_cachedReadPos < m_length) { return true; }
+        m_cachedReadPos = m_cursors->readPos.load(std::memory_order_acquire);
+        return wPos - m_cachedReadPos < m_length;
+    }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                         class TinySpscRingBuffer                          */
+/*              A lock-free SPSC Circular Object Buffer                      */
+/*                                                                           */
+/*****************************************************************************/
+
+template< class T, uint32_t SIZE >
+class TinySpscRingBuffer : public TinySpscRingBufferShell< T, TinyStaticIndex< SIZE > >
+{
+protected:
+    TinySpscCursors m_spscCursors;
+    T m_data[SIZE];
+
+public:
+    TinySpscRingBuffer() {
+        for (uint32_t i = 0; i < SIZE; i++) { m_data[i] = T(); }
+        this->init(m_data, SIZE, &m_spscCursors);
+    }
+    virtual ~TinySpscRingBuffer() { };
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                         class TinyMpmcRingBuffer                          */
+/*      Bounded lock-free queue for MANY producers and MANY consumers.       */
+/*  Each slot carries a sequence number that tells whose turn it is, so a    */
+/*  put or get is one CAS on a shared cursor (Vyukov). POLICY picks what a   */
+/*  put does when full: TINY_RING_REJECT fails, TINY_RING_OVERWRITE drops    */
+/*  the oldest entry like TinyRingBuffer, TINY_RING_BLOCK waits. put(val,    */
+/*  timeoutMs) and get(val, timeoutMs) wait by yielding, negative waits      */
+/*  forever (TINY_THREADS). No counters, shared ones would bring back the    */
+/*  contention that the per-slot sequence numbers avoid.                     */
+/*                                                                           */
+/*****************************************************************************/
+
+template< class T, uint32_t SIZE, TinyRingPolicy POLICY = TINY_RING_REJECT >
+class TinyMpmcRingBuffer
+{
+protected:
+    struct Cell
+    {
+        std::atomic< uint64_t > seq;
+        T data;
+    };
+    alignas(TINY_CACHE_LINE_SIZE) std::atomic< uint64_t > m_writePos;
+    alignas(TINY_CACHE_LINE_SIZE) std::atomic< uint64_t > m_readPos;
+    alignas(TINY_CACHE_LINE_SIZE) Cell m_cells[SIZE];
+
+public:
+    TinyMpmcRingBuffer() : m_writePos(0), m_readPos(0) {
+        for (uint32_t i = 0; i < SIZE; i++) { m_cells[i].seq.store(i, std::memory_order_relaxed); m_cells[i].data = T(); }
+    }
+    TinyMpmcRingBuffer(const TinyMpmcRingBuffer&) = delete;
+    TinyMpmcRingBuffer& operator=(const TinyMpmcRingBuffer&) = delete;
+    virtual ~TinyMpmcRingBuffer() { };
+
+    // A snapshot, other threads may move either cursor right after
+    SIZETYPE length() const {
+        uint64_t rPos = m_readPos.load(std::memory_order_acquire);
+        uint64_t wPos = m_writePos.load(std::memory_order_acquire);
+        return (wPos > rPos) ? (SIZETYPE)std::min< uint64_t >(wPos - rPos, SIZE) : 0;
+    }
+    SIZETYPE capacity() const { return SIZE; };
+    bool end() const { return length() == 0; }
+
+    // Try variants never wait, except put() under TINY_RING_BLOCK
+    bool put(const T& val) {
+        if (POLICY != TINY_RING_BLOCK) { return offer(val); }
+        while (!offer(val)) { TINY_YIELD(); }
+        return true;
+    }
+    bool get(T& val) { return tryGet(val); }
+    T get() { T val = T(); tryGet(val); return val; }
+
+#if defined(TINY_THREADS)
+    // Blocking variants: false only on timeout
+    bool put(const T& val, int32_t timeoutMs) { return TinyRingWait::until([&]() { return offer(val); }, timeoutMs); }
+    bool get(T& val, int32_t timeoutMs) { return TinyRingWait::until([&]() { return tryGet(val); }, timeoutMs); }
+#endif
+
+protected:
+    // OVERWRITE drops at most one entry per failed put, and only while the queue is really full.
+    // Otherwise a consumer is still copying out of the slot, so wait for it rather than drop newer entries.
+    bool offer(const T& val) {
+        while (!tryPut(val)) {
+            if (POLICY != TINY_RING_OVERWRITE) { return false; }
+            T oldest;
+            if (!(full() && tryGet(oldest))) { TINY_YIELD(); }
+        }
+        return true;
+    }
+    bool full() const {
+        uint64_t wPos = m_writePos.load(std::memory_order_acquire);
+        uint64_t rPos = m_readPos.load(std::memory_order_acquire);
+        return (wPos > rPos) && (wPos - rPos >= SIZE);
+    }
+    bool tryPut(const T& val) {
+        uint64_t pos = m_writePos.load(std::memory_order_relaxed);
+        Cell* cell = NULL;
+        while (true) {
+            cell = &m_cells[TinyStaticIndex< SIZE >::slot(pos, SIZE)];
+            int64_t diff = (int64_t)(cell->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (m_writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_writePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = val;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool tryGet(T& val) {
+        uint64_t pos = m_readPos.load(std::memory_order_relaxed);
+        Cell* cell = NULL;
+        while (true) {
+            cell = &m_cells[TinyStaticIndex< SIZE >::slot(pos, SIZE)];
+            int64_t diff = (int64_t)(cell->seq.load(std::memory_order_acquire) - (pos + 1));
+            if (diff == 0) {
+                if (m_readPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_readPos.load(std::memory_order_relaxed);
+            }
+        }
+        val = cell->data;
+        cell->seq.store(pos + SIZE, std::memory_order_release);
+        return true;
+    }
+};
+
+
 /*****************************************************************************/
 /*                                                                           */
 /*                            class TinyRingBuffer                           */
@@ -120,27 +614,117 @@ class TinyCircularBuffer : public TinyRingBufferShell< uint8_t >
 {
 protected:
     uint8_t* m_data;
-    uint32_t m_size;
+    SIZETYPE m_size;
     uint64_t m_rPos;
     uint64_t m_wPos;
 
 public:
-    TinyCircularBuffer(uint32_t size) : m_rPos(0), m_wPos(0) {
+    // Nothing is read before it is written, so the storage is not zero-filled.
+    TinyCircularBuffer(SIZETYPE size) : m_rPos(0), m_wPos(0) {
         m_size = size;
         m_data = new uint8_t[m_size];
-        for (uint32_t i = 0; i < m_size; i++) m_data[i] = 0;
         init(m_data, m_size, &m_rPos, &m_wPos);
     }
     virtual ~TinyCircularBuffer() { delete[] m_data; m_data = NULL; };
 
-    uint32_t write(const uint8_t* buffer, uint32_t len) {
-        for (uint32_t i = 0; i < len; ++i) { put(buffer[i]); }
+    using TinyRingBufferShell< uint8_t >::peek;
+
+    // Same result as put() byte by byte: under OVERWRITE only the newest m_size bytes survive,
+    // otherwise only what fits is written. Returns the bytes taken from buffer.
+    SIZETYPE write(const uint8_t* buffer, SIZETYPE len) {
+        len = admit(len);
+        SIZETYPE skip = (len > m_size) ? (len - m_size) : 0;
+        copyIn(m_wPos + skip, buffer + skip, len - skip);
+        m_wPos += len;
+        settle(len);
+        adjust();
         return len;
     }
-    uint32_t read(uint8_t* buffer, uint32_t size) {
-        uint32_t readed = 0;
-        for ( ; (readed < size) && !end(); ++readed) { buffer[readed] = get(); }
-        return   readed;
+    SIZETYPE read(uint8_t* buffer, SIZETYPE size) {
+        SIZETYPE readed = peek(buffer, size, 0);
+        m_rPos += readed;
+        m_stats.totalOut += readed;
+        return readed;
+    }
+    SIZETYPE peek(uint8_t* buffer, SIZETYPE len, SIZETYPE offset) {
+        SIZETYPE available = length();
+        if (offset >= available) { return 0; }
+        SIZETYPE peeked = (len < available - offset) ? len : (available - offset);
+        copyOut(m_rPos + offset, buffer, peeked);
+        return peeked;
+    }
+
+protected:
+    // At most two memcpy per call: up to the end of the buffer, then from its head.
+    void copyIn(uint64_t pos, const uint8_t* buffer, SIZETYPE len) {
+        TinySpanPair< uint8_t > pair = spans(pos, len);
+        memcpy(pair.first.data, buffer, pair.first.length);
+        memcpy(pair.second.data, buffer + pair.first.length, pair.second.length);
+    }
+    void copyOut(uint64_t pos, uint8_t* buffer, SIZETYPE len) const {
+        TinySpanPair< uint8_t > pair = spans(pos, len);
+        memcpy(buffer, pair.first.data, pair.first.length);
+        memcpy(buffer + pair.first.length, pair.second.data, pair.second.length);
+    }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                     class TinyGrowableCircularBuffer                      */
+/*              A Circular Memory Buffer that follows the load               */
+/*  A write that does not fit doubles the buffer up to maxSize, then the     */
+/*  policy applies. SHRINK_AFTER reads in a row at a quarter full or less    */
+/*  halve it back towards the initial size. Only unread bytes are moved.     */
+/*                                                                           */
+/*****************************************************************************/
+
+class TinyGrowableCircularBuffer : public TinyCircularBuffer
+{
+protected:
+    typedef TinyCircularBuffer Base;
+
+    SIZETYPE m_minSize;
+    SIZETYPE m_maxSize;
+    uint32_t m_idleReads;
+
+public:
+    static const uint32_t SHRINK_AFTER = 64;
+
+    // At least one byte, doubling a zero size would never make room.
+    TinyGrowableCircularBuffer(SIZETYPE size, SIZETYPE maxSize) : Base((size > 0) ? size : 1), m_minSize((size > 0) ? size : 1), m_idleReads(0) {
+        m_maxSize = (maxSize > m_minSize) ? maxSize : m_minSize;
+    }
+
+    SIZETYPE maxSize() const { return m_maxSize; }
+
+    bool put(uint8_t val) { if (m_size < m_maxSize) { reserve(1); } return Base::put(val); }
+    uint8_t get() { uint8_t val = Base::get(); if (m_size > m_minSize) { idle(); } return val; }
+    SIZETYPE write(const uint8_t* buffer, SIZETYPE len) { if (m_size < m_maxSize) { reserve(len); } return Base::write(buffer, len); }
+    SIZETYPE read(uint8_t* buffer, SIZETYPE size) { SIZETYPE readed = Base::read(buffer, size); if (m_size > m_minSize) { idle(); } return readed; }
+
+protected:
+    // Only a write that does not fit leaves the inlined check.
+    void reserve(SIZETYPE len) { if (len > m_size - length()) { grow(len); } }
+    // Grow by doubling so that a write of len bytes fits, as far as maxSize allows.
+    TINY_NOINLINE void grow(SIZETYPE len) {
+        SIZETYPE used = length();
+        SIZETYPE size = m_size;
+        while ((size - used < len) && (size < m_maxSize)) { size = (size > m_maxSize / 2) ? m_maxSize : size * 2; }
+        resize(size);
+    }
+    void idle() {
+        if (length() > m_size / 4) { m_idleReads = 0; return; }
+        if (++m_idleReads >= SHRINK_AFTER) { m_idleReads = 0; resize((m_size / 2 > m_minSize) ? m_size / 2 : m_minSize); }
+    }
+    // Moves the unread bytes to the start of a new buffer, the cursors restart from there.
+    TINY_NOINLINE void resize(SIZETYPE size) {
+        SIZETYPE used = length();
+        uint8_t* data = new uint8_t[size];
+        copyOut(m_rPos, data, used);
+        delete[] m_data;
+        m_data = data; m_size = size; m_rPos = 0; m_wPos = used;
+        init(m_data, m_size, &m_rPos, &m_wPos);
     }
 };
 
@@ -158,99 +742,971 @@ class TinySmooth
 {
 protected:
     TinyRingBuffer< T, SIZE > m_ringBuffer;
+    T m_sum;
+    T m_compensation;                               // Kahan compensation, always zero for integer types.
+    uint32_t m_appended;                            // Samples appended since the last resync.
+    static const uint32_t RESYNC_PERIOD = 64;       // Re-sum the window every RESYNC_PERIOD * SIZE samples.
 public:
-    TinySmooth() { };
+    TinySmooth() : m_sum(), m_compensation(), m_appended(0) { };
     ~TinySmooth() { };
 
     void appendData(const T& val) {
+        if (m_ringBuffer.length() == SIZE) {
+            accumulate(T() - m_ringBuffer.peek(0));
+        }
         m_ringBuffer.put(val);
+        accumulate(val);
+        if (++m_appended >= RESYNC_PERIOD * SIZE) {
+            resync();
+        }
     };
     T smoothedData() {
-        T val = T();
+        T val = m_sum;
         uint32_t len = m_ringBuffer.length();
-        for (uint32_t i = 0; i < len; i++) {
-            val += m_ringBuffer.peek(i);
-        }
         if (len > 1) {
             val /= len;
         }
         return val;
     }
+    void resync() {
+        m_sum = T();
+        m_compensation = T();
+        m_appended = 0;
+        uint32_t len = m_ringBuffer.length();
+        for (uint32_t i = 0; i < len; i++) {
+            m_sum += m_ringBuffer.peek(i);
+        }
+    }
+protected:
+    void accumulate(const T& val) {
+        T y = val - m_compensation;
+        T t = m_sum + y;
+        m_compensation = (t - m_sum) - y;
+        m_sum = t;
+    }
 };
 
-
 /*****************************************************************************/
 /*                                                                           */
-/*                          class TinyBitFieldShell                          */
-/*            A tiny class to help you manage large count of bits.           */
-/*  NOTE: The buffer must fit the capacity (buffer size >= capacity / 8).    */
-/*  WRANING: The C++ memory function may not support uint64 for memory size. */
+/*                               class TinyEma                               */
+/*     Exponential moving average, SIZE is the span: alpha = 2 / (SIZE + 1). */
 /*                                                                           */
 /*****************************************************************************/
 
-#define SIZETYPE uint32_t
-
-class TinyBitFieldShell
+template< class T, uint32_t SIZE >
+class TinyEma
 {
 protected:
-    uint8_t* m_bitField;
-    SIZETYPE m_capacity;
+    double m_ema;
+    bool m_empty;
 public:
-    TinyBitFieldShell(uint8_t* buffer, SIZETYPE capacity) : m_bitField(buffer), m_capacity(capacity) { }
-    virtual ~TinyBitFieldShell() { }
+    TinyEma() : m_ema(0.0), m_empty(true) { };
+    ~TinyEma() { };
 
-    void bitSet(SIZETYPE bit) { if (bitValidation(bit)) { m_bitField[bit / 8] |= (uint8_t)1 << (bit % 8); } }
-    void bitClr(SIZETYPE bit) { if (bitValidation(bit)) { m_bitField[bit / 8] &= ~((uint8_t)1 << (bit % 8)); } }
-    uint8_t bitGet(SIZETYPE bit) { return bitCheck(bit) ? 1 : 0; }
-    bool bitCheck(SIZETYPE bit) { return bitValidation(bit) ? (m_bitField[bit / 8] & ((uint8_t)1 << (bit % 8))) != 0 : false; }
-protected:
-    bool bitValidation(SIZETYPE bit) { return (m_bitField != NULL) && (bit < m_capacity); }
+    void appendData(const T& val) {
+        if (m_empty) {
+            m_ema = (double)val;
+            m_empty = false;
+        } else {
+            m_ema += (2.0 / (SIZE + 1)) * ((double)val - m_ema);
+        }
+    };
+    T smoothedData() const { return (T)m_ema; }
 };
 
 
 /*****************************************************************************/
 /*                                                                           */
-/*                            class TinyBitField                             */
+/*                         class TinySlidingExtremum                         */
+/*      Min or max of the last SIZE points with a monotonic deque.           */
+/*      Amortized O(1) per point. Use TinySlidingMin / TinySlidingMax.       */
 /*                                                                           */
 /*****************************************************************************/
 
-class TinyBitField : public TinyBitFieldShell
+template< class T, uint32_t SIZE, bool MINIMUM >
+class TinySlidingExtremum
 {
 protected:
-    SIZETYPE m_fieldlen;
+    T m_value[SIZE];
+    uint64_t m_seq[SIZE];
+    uint64_t m_head;                // Front of the deque, the current extremum.
+    uint64_t m_tail;                // One past the back of the deque.
+    uint64_t m_count;               // Points appended.
 public:
-    TinyBitField() : TinyBitFieldShell(NULL, 0), m_fieldlen(0) { }
-    TinyBitField(SIZETYPE capacity) : TinyBitFieldShell(NULL, 0), m_fieldlen(0){ init(capacity); }
-    ~TinyBitField() { destroy(); }
+    TinySlidingExtremum() : m_head(0), m_tail(0), m_count(0) {
+        for (uint32_t i = 0; i < SIZE; i++) { m_value[i] = T(); m_seq[i] = 0; }
+    };
+    ~TinySlidingExtremum() { };
 
-    bool init(SIZETYPE capacity) { destroy();
-        if (capacity > 0) {
-            m_capacity = capacity; m_fieldlen = capacity / 8 + 1;
-            m_bitField = new uint8_t[m_fieldlen];
-            memset(m_bitField, 0, m_fieldlen);
-        }
-        return true;
-    }
-    bool destroy() { delete[] m_bitField; m_bitField = NULL; m_fieldlen = m_capacity = 0;  return true; };
+    void appendData(const T& val) {
+        if ((m_tail > m_head) && (m_seq[slot(m_head)] + SIZE <= m_count)) { ++m_head; }
+        // Older candidates that are not better than val can never be the extremum again.
+        while ((m_tail > m_head) && !better(m_value[slot(m_tail - 1)], val)) { --m_tail; }
+        m_value[slot(m_tail)] = val;
+        m_seq[slot(m_tail)] = m_count++;
+        ++m_tail;
+    };
+    T smoothedData() const { return (m_tail > m_head) ? m_value[slot(m_head)] : T(); }
+protected:
+    static uint32_t slot(uint64_t pos) { return TinyStaticIndex< SIZE >::slot(pos, SIZE); }
+    static bool better(const T& lhs, const T& rhs) { return MINIMUM ? (lhs < rhs) : (rhs < lhs); }
 };
 
+template< class T, uint32_t SIZE > using TinySlidingMin = TinySlidingExtremum< T, SIZE, true >;
+template< class T, uint32_t SIZE > using TinySlidingMax = TinySlidingExtremum< T, SIZE, false >;
+
 
 /*****************************************************************************/
 /*                                                                           */
-/*                              class BitField                               */
-/*                      Original design. Kind of heavy.                      */
-/*                Maybe we should remove it form Tiny Family.                */
+/*                         class TinySlidingVariance                         */
+/*    Mean, variance and standard deviation of the last SIZE points.         */
+/*    Welford update in O(1), re-computed periodically against drift.        */
+/*                                                                           */
 /*****************************************************************************/
 
-class BitField : public TinyBitField
+template< class T, uint32_t SIZE >
+class TinySlidingVariance
 {
+protected:
+    TinyRingBuffer< T, SIZE > m_ringBuffer;
+    uint32_t m_length;
+    double m_mean;
+    double m_m2;                                    // Sum of squared differences from the mean.
+    uint32_t m_appended;                            // Points appended since the last resync.
+    static const uint32_t RESYNC_PERIOD = 64;       // Re-compute every RESYNC_PERIOD * SIZE points.
 public:
-    BitField(SIZETYPE capacity) : TinyBitField(capacity){ }
-    BitField(const BitField& rhs) : TinyBitField(0) { operator=(rhs); }
-    ~BitField() { }
+    TinySlidingVariance() : m_length(0), m_mean(0.0), m_m2(0.0), m_appended(0) { };
+    ~TinySlidingVariance() { };
 
-    BitField& operator=(const BitField& rhs) {
-        if (rhs.m_bitField != NULL) {
+    void appendData(const T& val) {
+        double x = (double)val;
+        if (m_length == SIZE) {
+            double old = (double)m_ringBuffer.peek(0);
+            double mean = m_mean + (x - old) / SIZE;
+            m_m2 += (x - old) * (x - mean + old - m_mean);
+            m_mean = mean;
+        } else {
+            double delta = x - m_mean;
+            m_mean += delta / (++m_length);
+            m_m2 += delta * (x - m_mean);
+        }
+        if (m_m2 < 0.0) { m_m2 = 0.0; }
+        m_ringBuffer.put(val);
+        if (++m_appended >= RESYNC_PERIOD * SIZE) {
+            resync();
+        }
+    };
+    T smoothedData() const { return (T)m_mean; }
+    double mean() const { return m_mean; }
+    double variance() const { return (m_length > 1) ? m_m2 / (m_length - 1) : 0.0; }
+    double stddev() const { return sqrt(variance()); }
+
+    void resync() {
+        double sum = 0.0;
+        m_appended = 0;
+        for (uint32_t i = 0; i < m_length; i++) { sum += (double)m_ringBuffer.peek(i); }
+        m_mean = (m_length > 0) ? sum / m_length : 0.0;
+        m_m2 = 0.0;
+        for (uint32_t i = 0; i < m_length; i++) {
+            double delta = (double)m_ringBuffer.peek(i) - m_mean;
+            m_m2 += delta * delta;
+        }
+    }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                          class TinySlidingMedian                          */
+/*      Median of the last SIZE points in O(log SIZE) per point.             */
+/*  A max-heap (lower half) and a min-heap (upper half) share one array,     */
+/*  with the median at index 0: the max-heap grows to negative indexes and   */
+/*  the min-heap to positive ones. Every point knows its heap index, so the  */
+/*  evicted point is replaced in place instead of searched.                  */
+/*                                                                           */
+/*****************************************************************************/
+
+template< class T, uint32_t SIZE >
+class TinySlidingMedian
+{
+protected:
+    T m_data[SIZE];
+    int32_t m_pos[SIZE];                // Heap index of every point.
+    int32_t m_heapBuffer[SIZE];
+    int32_t* m_heap;                    // Middle of m_heapBuffer, holds the point slot of every heap index.
+    uint32_t m_index;                   // Slot of the next point.
+    uint32_t m_count;
+public:
+    TinySlidingMedian() : m_heap(m_heapBuffer + SIZE / 2), m_index(0), m_count(0) {
+        // Fill pattern: median, max, min, max, min...
+        for (int32_t i = SIZE - 1; i >= 0; i--) {
+            m_data[i] = T();
+            m_pos[i] = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+            m_heap[m_pos[i]] = i;
+        }
+    };
+    ~TinySlidingMedian() { };
+
+    void appendData(const T& val) {
+        bool isNew = (m_count < SIZE);
+        int32_t p = m_pos[m_index];
+        T old = m_data[m_index];
+        m_data[m_index] = val;
+        m_index = (m_index + 1 < SIZE) ? (m_index + 1) : 0;
+        if (isNew) { ++m_count; }
+
+        if (p > 0) {
+            if (!isNew && (old < val)) { minSortDown(p * 2); }
+            else if (minSortUp(p)) { maxSortDown(-1); }
+        } else if (p < 0) {
+            if (!isNew && (val < old)) { maxSortDown(p * 2); }
+            else if (maxSortUp(p)) { minSortDown(1); }
+        } else {
+            if (maxCount() > 0) { maxSortDown(-1); }
+            if (minCount() > 0) { minSortDown(1); }
+        }
+    };
+    T smoothedData() const {
+        if (m_count == 0) { return T(); }
+        T val = m_data[m_heap[0]];
+        if ((m_count & 1) == 0) { val = (val + m_data[m_heap[-1]]) / 2; }
+        return val;
+    }
+protected:
+    int32_t minCount() const { return (int32_t)(m_count - 1) / 2; }
+    int32_t maxCount() const { return (int32_t)m_count / 2; }
+
+    bool less(int32_t i, int32_t j) const { return m_data[m_heap[i]] < m_data[m_heap[j]]; }
+    bool exchangeIfLess(int32_t i, int32_t j) {
+        if (!less(i, j)) { return false; }
+        int32_t t = m_heap[i]; m_heap[i] = m_heap[j]; m_heap[j] = t;
+        m_pos[m_heap[i]] = i; m_pos[m_heap[j]] = j;
+        return true;
+    }
+    // Restore the heap below i / 2, index 1 and -1 are the only children of the median.
+    void minSortDown(int32_t i) {
+        for (; i <= minCount(); i *= 2) {
+            if ((i > 1) && (i < minCount()) && less(i + 1, i)) { ++i; }
+            if (!exchangeIfLess(i, i / 2)) { break; }
+        }
+    }
+    void maxSortDown(int32_t i) {
+        for (; i >= -maxCount(); i *= 2) {
+            if ((i < -1) && (i > -maxCount()) && less(i, i - 1)) { --i; }
+            if (!exchangeIfLess(i / 2, i)) { break; }
+        }
+    }
+    // Return true if the point reached the median.
+    bool minSortUp(int32_t i) {
+        while ((i > 0) && exchangeIfLess(i, i / 2)) { i /= 2; }
+        return i == 0;
+    }
+    bool maxSortUp(int32_t i) {
+        while ((i < 0) && exchangeIfLess(i / 2, i)) { i /= 2; }
+        return i == 0;
+    }
+};
+
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                          class TinyBitFieldShell                          */
+/*            A tiny class to help you manage large count of bits.           */
+/*  NOTE: The buffer must fit the capacity (buffer size >= capacity / 8).    */
+/*  WRANING: The C++ memory function may not support uint64 for memory size. */
+/*                                                                           */
+/*****************************************************************************/
+
+class TinyBitFieldShell
+{
+protected:
+    uint8_t* m_bitField;
+    SIZETYPE m_capacity;
+public:
+    TinyBitFieldShell(uint8_t* buffer, SIZETYPE capacity) : m_bitField(buffer), m_capacity(capacity) { }
+    virtual ~TinyBitFieldShell() { }
+
+    void bitSet(SIZETYPE bit) { if (bitValidation(bit)) { m_bitField[bit / 8] |= (uint8_t)1 << (bit % 8); } }
+    void bitClr(SIZETYPE bit) { if (bitValidation(bit)) { m_bitField[bit / 8] &= ~((uint8_t)1 << (bit % 8)); } }
+    uint8_t bitGet(SIZETYPE bit) { return bitCheck(bit) ? 1 : 0; }
+    bool bitCheck(SIZETYPE bit) { return bitValidation(bit) ? (m_bitField[bit / 8] & ((uint8_t)1 << (bit % 8))) != 0 : false; }
+    SIZETYPE capacity() const { return m_capacity; }
+protected:
+    bool bitValidation(SIZETYPE bit) { return (m_bitField != NULL) && (bit < m_capacity); }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                            struct TinyBitKernel                           */
+/*        Bulk logical operations over 64-bit words of a bit field.          */
+/*  The vector unit is picked at build time: AVX2, SSE2, NEON, or scalar     */
+/*  words if none is available or TINY_BITOPS_SCALAR is defined.             */
+/*                                                                           */
+/*****************************************************************************/
+
+struct TinyBitScalar
+{
+    typedef uint64_t Vector;
+    static const uint32_t WORDS = 1;
+
+    static Vector load(const uint64_t* p) { return *p; }
+    static void store(uint64_t* p, Vector v) { *p = v; }
+    static Vector vAnd(Vector lhs, Vector rhs) { return lhs & rhs; }
+    static Vector vOr(Vector lhs, Vector rhs) { return lhs | rhs; }
+    static Vector vXor(Vector lhs, Vector rhs) { return lhs ^ rhs; }
+    static Vector vNot(Vector v) { return ~v; }
+    static Vector fill(bool ones) { return ones ? ~(uint64_t)0 : 0; }
+    static bool zero(Vector v) { return v == 0; }
+};
+
+#if !defined(TINY_BITOPS_SCALAR) && defined(__AVX2__)
+
+#include <immintrin.h>
+struct TinyBitAvx2
+{
+    typedef __m256i Vector;
+    static const uint32_t WORDS = 4;
+
+    static Vector load(const uint64_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+    static void store(uint64_t* p, Vector v) { _mm256_storeu_si256((__m256i*)p, v); }
+    static Vector vAnd(Vector lhs, Vector rhs) { return _mm256_and_si256(lhs, rhs); }
+    static Vector vOr(Vector lhs, Vector rhs) { return _mm256_or_si256(lhs, rhs); }
+    static Vector vXor(Vector lhs, Vector rhs) { return _mm256_xor_si256(lhs, rhs); }
+    static Vector vNot(Vector v) { return _mm256_xor_si256(v, _mm256_set1_epi32(-1)); }
+    static Vector fill(bool ones) { return _mm256_set1_epi32(ones ? -1 : 0); }
+    static bool zero(Vector v) { return _mm256_testz_si256(v, v) != 0; }
+};
+typedef TinyBitAvx2 TinyBitVector;
+
+#elif !defined(TINY_BITOPS_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+
+#include <emmintrin.h>
+struct TinyBitSse2
+{
+    typedef __m128i Vector;
+    static const uint32_t WORDS = 2;
+
+    static Vector load(const uint64_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+    static void store(uint64_t* p, Vector v) { _mm_storeu_si128((__m128i*)p, v); }
+    static Vector vAnd(Vector lhs, Vector rhs) { return _mm_and_si128(lhs, rhs); }
+    static Vector vOr(Vector lhs, Vector rhs) { return _mm_or_si128(lhs, rhs); }
+    static Vector vXor(Vector lhs, Vector rhs) { return _mm_xor_si128(lhs, rhs); }
+    static Vector vNot(Vector v) { return _mm_xor_si128(v, _mm_set1_epi32(-1)); }
+    static Vector fill(bool ones) { return _mm_set1_epi32(ones ? -1 : 0); }
+    static bool zero(Vector v) { return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) == 0xFFFF; }
+};
+typedef TinyBitSse2 TinyBitVector;
+
+#elif !defined(TINY_BITOPS_SCALAR) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+
+#include <arm_neon.h>
+struct TinyBitNeon
+{
+    typedef uint64x2_t Vector;
+    static const uint32_t WORDS = 2;
+
+    static Vector load(const uint64_t* p) { return vld1q_u64(p); }
+    static void store(uint64_t* p, Vector v) { vst1q_u64(p, v); }
+    static Vector vAnd(Vector lhs, Vector rhs) { return vandq_u64(lhs, rhs); }
+    static Vector vOr(Vector lhs, Vector rhs) { return vorrq_u64(lhs, rhs); }
+    static Vector vXor(Vector lhs, Vector rhs) { return veorq_u64(lhs, rhs); }
+    static Vector vNot(Vector v) { return veorq_u64(v, vdupq_n_u64(~(uint64_t)0)); }
+    static Vector fill(bool ones) { return vdupq_n_u64(ones ? ~(uint64_t)0 : 0); }
+    static bool zero(Vector v) { return (vgetq_lane_u64(v, 0) | vgetq_lane_u64(v, 1)) == 0; }
+};
+typedef TinyBitNeon TinyBitVector;
+
+#else
+
+typedef TinyBitScalar TinyBitVector;
+
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Bit n of a field is bit (n % 8) of byte (n / 8), a word read from memory needs a swap on big endian.
+struct TinyBitWord
+{
+    static uint64_t bits(uint64_t word) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return __builtin_bswap64(word);
+#else
+        return word;
+#endif
+    }
+    // The popcnt instruction only when the build targets it, otherwise the compiler may emit a library call.
+    static uint32_t popcount(uint64_t v) {
+#if defined(_MSC_VER) && defined(_M_X64) && defined(__AVX__)
+        return (uint32_t)__popcnt64(v);
+#elif defined(__GNUC__) && (defined(__POPCNT__) || defined(__ARM_NEON))
+        return (uint32_t)__builtin_popcountll(v);
+#else
+        v = v - ((v >> 1) & 0x5555555555555555ULL);
+        v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+        v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (uint32_t)((v * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+    // The bits of the last word that are below capacity.
+    static uint64_t tailMask(SIZETYPE capacity) {
+        return (capacity % 64) ? bits(((uint64_t)1 << (capacity % 64)) - 1) : ~(uint64_t)0;
+    }
+    // Index of the lowest set bit, v must not be zero.
+    static uint32_t ctz(uint64_t v) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index; _BitScanForward64(&index, v); return (uint32_t)index;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, (uint32_t)v)) { return (uint32_t)index; }
+        _BitScanForward(&index, (uint32_t)(v >> 32)); return (uint32_t)index + 32;
+#elif defined(__GNUC__)
+        return (uint32_t)__builtin_ctzll(v);
+#else
+        uint32_t index = 0;
+        while ((v & 1) == 0) { v >>= 1; ++index; }
+        return index;
+#endif
+    }
+};
+
+template< class V >
+struct TinyBitKernel
+{
+    static void opAnd(uint64_t* dst, const uint64_t* src, SIZETYPE words) {
+        SIZETYPE i = 0;
+        for (; i + V::WORDS <= words; i += V::WORDS) { V::store(dst + i, V::vAnd(V::load(dst + i), V::load(src + i))); }
+        for (; i < words; ++i) { dst[i] &= src[i]; }
+    }
+    static void opOr(uint64_t* dst, const uint64_t* src, SIZETYPE words) {
+        SIZETYPE i = 0;
+        for (; i + V::WORDS <= words; i += V::WORDS) { V::store(dst + i, V::vOr(V::load(dst + i), V::load(src + i))); }
+        for (; i < words; ++i) { dst[i] |= src[i]; }
+    }
+    static void opXor(uint64_t* dst, const uint64_t* src, SIZETYPE words) {
+        SIZETYPE i = 0;
+        for (; i + V::WORDS <= words; i += V::WORDS) { V::store(dst + i, V::vXor(V::load(dst + i), V::load(src + i))); }
+        for (; i < words; ++i) { dst[i] ^= src[i]; }
+    }
+    static void opNot(uint64_t* dst, SIZETYPE words) {
+        SIZETYPE i = 0;
+        for (; i + V::WORDS <= words; i += V::WORDS) { V::store(dst + i, V::vNot(V::load(dst + i))); }
+        for (; i < words; ++i) { dst[i] = ~dst[i]; }
+    }
+    static bool allZero(const uint64_t* src, SIZETYPE words) {
+        SIZETYPE i = 0;
+        for (; i + 4 * V::WORDS <= words; i += 4 * V::WORDS) {
+            typename V::Vector v = V::vOr(V::vOr(V::load(src + i), V::load(src + i + V::WORDS)),
+                                          V::vOr(V::load(src + i + 2 * V::WORDS), V::load(src + i + 3 * V::WORDS)));
+            if (!V::zero(v)) { return false; }
+        }
+        for (; i < words; ++i) { if (src[i] != 0) { return false; } }
+        return true;
+    }
+    // Index of the first word from 'from' that is not all zero (ones = false) or all one (ones = true).
+    static SIZETYPE skipWords(const uint64_t* src, SIZETYPE from, SIZETYPE words, bool ones) {
+        SIZETYPE i = from;
+        uint64_t skip = ones ? ~(uint64_t)0 : 0;
+        typename V::Vector pattern = V::fill(ones);
+        for (; i + 4 * V::WORDS <= words; i += 4 * V::WORDS) {
+            typename V::Vector v = V::vOr(V::vOr(V::vXor(V::load(src + i), pattern), V::vXor(V::load(src + i + V::WORDS), pattern)),
+                                          V::vOr(V::vXor(V::load(src + i + 2 * V::WORDS), pattern), V::vXor(V::load(src + i + 3 * V::WORDS), pattern)));
+            if (!V::zero(v)) { break; }
+        }
+        for (; i < words; ++i) { if (src[i] != skip) { break; } }
+        return i;
+    }
+};
+
+typedef TinyBitKernel< TinyBitVector > TinyBitOps;
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                            class TinyBitField                             */
+/*                                                                           */
+/*****************************************************************************/
+
+class TinyBitField : public TinyBitFieldShell
+{
+protected:
+    SIZETYPE m_fieldlen;
+    uint64_t* m_words;          // Same memory as m_bitField, bit n is bit (n % 8) of byte (n / 8).
+    SIZETYPE m_wordlen;
+    bool m_owned;               // False when the words were attached.
+public:
+    TinyBitField() : TinyBitFieldShell(NULL, 0), m_fieldlen(0), m_words(NULL), m_wordlen(0), m_owned(false) { }
+    TinyBitField(SIZETYPE capacity) : TinyBitFieldShell(NULL, 0), m_fieldlen(0), m_words(NULL), m_wordlen(0), m_owned(false) { init(capacity); }
+    ~TinyBitField() { destroy(); }
+
+    bool init(SIZETYPE capacity) { destroy();
+        if (capacity > 0) {
+            m_capacity = capacity; m_wordlen = capacity / 64 + ((capacity % 64) ? 1 : 0); m_fieldlen = m_wordlen * 8;
+            m_words = new uint64_t[m_wordlen]; m_owned = true;
+            memset(m_words, 0, m_fieldlen);
+            m_bitField = (uint8_t*)m_words;
+        }
+        return true;
+    }
+    // Use (capacity + 63) / 64 external words, the bits beyond capacity must be zero. They are never freed here.
+    bool attach(uint64_t* words, SIZETYPE capacity) { destroy();
+        if ((words != NULL) && (capacity > 0)) {
+            m_capacity = capacity; m_wordlen = capacity / 64 + ((capacity % 64) ? 1 : 0); m_fieldlen = m_wordlen * 8;
+            m_words = words;
+            m_bitField = (uint8_t*)m_words;
+        }
+        return true;
+    }
+    bool destroy() { if (m_owned) { delete[] m_words; } m_words = NULL; m_bitField = NULL; m_owned = false; m_wordlen = m_fieldlen = m_capacity = 0;  return true; };
+
+    uint64_t* words() { return m_words; }
+    const uint64_t* words() const { return m_words; }
+    SIZETYPE wordCount() const { return m_wordlen; }
+
+    // Searches return capacity() when nothing is found.
+    SIZETYPE count() const {
+        SIZETYPE total = 0;
+        for (SIZETYPE i = 0; i < m_wordlen; ++i) { total += TinyBitWord::popcount(m_words[i]); }
+        return total;
+    }
+    SIZETYPE findFirstSet(SIZETYPE from = 0) const { return find(from, false); }
+    SIZETYPE findFirstClear(SIZETYPE from = 0) const { return find(from, true); }
+    SIZETYPE findNextSet(SIZETYPE bit) const { return (bit < m_capacity) ? find(bit + 1, false) : m_capacity; }
+
+    // Forward iterator over the set bits: for (SIZETYPE bit : field) { ... }
+    class SetBitIterator
+    {
+    protected:
+        const TinyBitField* m_field;
+        SIZETYPE m_bit;
+    public:
+        SetBitIterator(const TinyBitField* field, SIZETYPE bit) : m_field(field), m_bit(bit) { }
+        SIZETYPE operator * () const { return m_bit; }
+        SetBitIterator& operator ++ () { m_bit = m_field->findNextSet(m_bit); return *this; }
+        bool operator == (const SetBitIterator& rhs) const { return m_bit == rhs.m_bit; }
+        bool operator != (const SetBitIterator& rhs) const { return m_bit != rhs.m_bit; }
+    };
+    SetBitIterator begin() const { return SetBitIterator(this, findFirstSet()); }
+    SetBitIterator end() const { return SetBitIterator(this, m_capacity); }
+protected:
+    SIZETYPE find(SIZETYPE from, bool clear) const {
+        if (from >= m_capacity) { return m_capacity; }
+        SIZETYPE word = from / 64;
+        uint64_t bits = (TinyBitWord::bits(m_words[word]) ^ (clear ? ~(uint64_t)0 : 0)) & (~(uint64_t)0 << (from % 64));
+        if (bits == 0) {
+            word = TinyBitOps::skipWords(m_words, word + 1, m_wordlen, clear);
+            if (word >= m_wordlen) { return m_capacity; }
+            bits = TinyBitWord::bits(m_words[word]) ^ (clear ? ~(uint64_t)0 : 0);
+        }
+        SIZETYPE bit = word * 64 + TinyBitWord::ctz(bits);
+        return (bit < m_capacity) ? bit : m_capacity;
+    }
+
+    // Keep the bits beyond capacity zero after a bulk operation touched the last word.
+    void clearTail() {
+        SIZETYPE used = m_capacity / 8;
+        if (m_capacity % 8) { m_bitField[used] &= (uint8_t)((1u << (m_capacity % 8)) - 1); ++used; }
+        if (used < m_fieldlen) { memset(m_bitField + used, 0, m_fieldlen - used); }
+    }
+};
+
+/*****************************************************************************/
+/*                                                                           */
+/*                      class TinyAtomicBitFieldShell                        */
+/*          A bit field that many threads may update at the same time.       */
+/*  Bits live in atomic words: bit n is bit (n % 64) of word (n / 64).       */
+/*  Updates are acq_rel, so a set bit also publishes what was written        */
+/*  before it.                                                               */
+/*  NOTE: The buffer must hold (capacity + 63) / 64 zeroed words.            */
+/*                                                                           */
+/*****************************************************************************/
+
+class TinyAtomicBitFieldShell
+{
+protected:
+    std::atomic<uint64_t>* m_words;
+    SIZETYPE m_capacity;
+    SIZETYPE m_wordlen;
+public:
+    TinyAtomicBitFieldShell(std::atomic<uint64_t>* words, SIZETYPE capacity)
+        : m_words(words), m_capacity(capacity), m_wordlen(capacity / 64 + ((capacity % 64) ? 1 : 0)) { }
+    virtual ~TinyAtomicBitFieldShell() { }
+
+    void bitSet(SIZETYPE bit) { if (bitValidation(bit)) { m_words[bit / 64].fetch_or(mask(bit), std::memory_order_acq_rel); } }
+    void bitClr(SIZETYPE bit) { if (bitValidation(bit)) { m_words[bit / 64].fetch_and(~mask(bit), std::memory_order_acq_rel); } }
+    uint8_t bitGet(SIZETYPE bit) const { return bitCheck(bit) ? 1 : 0; }
+    bool bitCheck(SIZETYPE bit) const { return bitValidation(bit) ? (m_words[bit / 64].load(std::memory_order_acquire) & mask(bit)) != 0 : false; }
+    SIZETYPE capacity() const { return m_capacity; }
+
+    // Return the value the bit had before.
+    bool testAndSet(SIZETYPE bit) { return bitValidation(bit) ? (m_words[bit / 64].fetch_or(mask(bit), std::memory_order_acq_rel) & mask(bit)) != 0 : false; }
+    bool testAndClr(SIZETYPE bit) { return bitValidation(bit) ? (m_words[bit / 64].fetch_and(~mask(bit), std::memory_order_acq_rel) & mask(bit)) != 0 : false; }
+
+    // Claim the lowest clear bit at or after 'from', capacity() if there is none.
+    SIZETYPE findFirstClearAndSet(SIZETYPE from = 0) {
+        if (!bitValidation(from)) { return m_capacity; }
+        for (SIZETYPE word = from / 64; word < m_wordlen; ++word) {
+            uint64_t usable = (word == from / 64) ? (~(uint64_t)0 << (from % 64)) : ~(uint64_t)0;
+            if ((word + 1 == m_wordlen) && (m_capacity % 64)) { usable &= ((uint64_t)1 << (m_capacity % 64)) - 1; }
+            uint64_t value = m_words[word].load(std::memory_order_relaxed);
+            while ((~value & usable) != 0) {
+                uint64_t bit = (uint64_t)1 << TinyBitWord::ctz(~value & usable);
+                if (m_words[word].compare_exchange_weak(value, value | bit, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    return word * 64 + TinyBitWord::ctz(bit);
+                }
+            }
+        }
+        return m_capacity;
+    }
+    // A snapshot, bits may change while it counts.
+    SIZETYPE count() const {
+        SIZETYPE total = 0;
+        for (SIZETYPE i = 0; i < m_wordlen; ++i) { total += TinyBitWord::popcount(m_words[i].load(std::memory_order_relaxed)); }
+        return total;
+    }
+protected:
+    bool bitValidation(SIZETYPE bit) const { return (m_words != NULL) && (bit < m_capacity); }
+    static uint64_t mask(SIZETYPE bit) { return (uint64_t)1 << (bit % 64); }
+};
+
+class TinyAtomicBitField : public TinyAtomicBitFieldShell
+{
+public:
+    TinyAtomicBitField(SIZETYPE capacity) : TinyAtomicBitFieldShell(NULL, capacity) {
+        if (m_wordlen > 0) { m_words = new std::atomic<uint64_t>[m_wordlen]; }
+        zeroAll();
+    }
+    TinyAtomicBitField(const TinyAtomicBitField&) = delete;
+    TinyAtomicBitField& operator=(const TinyAtomicBitField&) = delete;
+    ~TinyAtomicBitField() { delete[] m_words; m_words = NULL; }
+
+    // Not atomic as a whole, call it while no other thread uses the field.
+    void zeroAll() { for (SIZETYPE i = 0; i < m_wordlen; ++i) { m_words[i].store(0, std::memory_order_relaxed); } }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                      class TinyHierarchicalBitField                       */
+/*          A bit field with summary levels for fast slot allocation.        */
+/*  Each summary level has one bit per word of the level below: the "full"   */
+/*  summary marks all-one words, the "any" summary marks non-zero words.     */
+/*  allocate(), release() and the searches are O(log64 capacity).            */
+/*  NOTE: Change bits through this class only, or call rebuild() after.      */
+/*                                                                           */
+/*****************************************************************************/
+
+#define TINY_HIERARCHY_MAX_LEVELS 11
+
+class TinyHierarchicalBitField : public TinyBitField
+{
+protected:
+    uint64_t* m_summary;
+    uint64_t* m_full[TINY_HIERARCHY_MAX_LEVELS + 1];
+    uint64_t* m_any[TINY_HIERARCHY_MAX_LEVELS + 1];
+    SIZETYPE m_levelWords[TINY_HIERARCHY_MAX_LEVELS + 1];
+    uint32_t m_levels;                      // Summary levels above the bits, the top one is a single word.
+public:
+    TinyHierarchicalBitField() : m_summary(NULL), m_levels(0) { }
+    TinyHierarchicalBitField(SIZETYPE capacity) : m_summary(NULL), m_levels(0) { init(capacity); }
+    ~TinyHierarchicalBitField() { destroy(); }
+
+    bool init(SIZETYPE capacity) {
+        destroy();
+        TinyBitField::init(capacity);
+        if (m_wordlen == 0) { return true; }
+
+        SIZETYPE total = 0;
+        m_levelWords[0] = m_wordlen;
+        while (m_levelWords[m_levels] > 1) {
+            ++m_levels;
+            m_levelWords[m_levels] = m_levelWords[m_levels - 1] / 64 + ((m_levelWords[m_levels - 1] % 64) ? 1 : 0);
+            total += m_levelWords[m_levels];
+        }
+        m_summary = new uint64_t[total * 2 + 1];
+        SIZETYPE offset = 0;
+        for (uint32_t level = 1; level <= m_levels; offset += m_levelWords[level++] * 2) {
+            m_full[level] = m_summary + offset;
+            m_any[level] = m_summary + offset + m_levelWords[level];
+        }
+        rebuild();
+        return true;
+    }
+    bool destroy() {
+        delete[] m_summary; m_summary = NULL; m_levels = 0;
+        return TinyBitField::destroy();
+    }
+    // Re-compute the summaries from the bits.
+    void rebuild() {
+        for (uint32_t level = 1; level <= m_levels; ++level) {
+            SIZETYPE below = m_levelWords[level - 1];
+            memset(m_any[level], 0, m_levelWords[level] * 8);
+            memset(m_full[level], 0, m_levelWords[level] * 8);
+            // Words that do not exist below count as full, so a search for a clear bit never goes there.
+            for (SIZETYPE i = below; i < m_levelWords[level] * 64; ++i) { m_full[level][i / 64] |= (uint64_t)1 << (i % 64); }
+            for (SIZETYPE i = 0; i < below; ++i) {
+                uint64_t full = (level == 1) ? m_words[i] : m_full[level - 1][i];
+                uint64_t any = (level == 1) ? m_words[i] : m_any[level - 1][i];
+                if (full == ~(uint64_t)0) { m_full[level][i / 64] |= (uint64_t)1 << (i % 64); }
+                if (any != 0) { m_any[level][i / 64] |= (uint64_t)1 << (i % 64); }
+            }
+        }
+    }
+
+    void bitSet(SIZETYPE bit) {
+        if (!bitValidation(bit)) { return; }
+        SIZETYPE word = bit / 64;
+        uint64_t before = m_words[word];
+        TinyBitField::bitSet(bit);
+        if (before == 0) { markAny(word, true); }
+        if (m_words[word] == ~(uint64_t)0) { markFull(word, true); }
+    }
+    void bitClr(SIZETYPE bit) {
+        if (!bitValidation(bit)) { return; }
+        SIZETYPE word = bit / 64;
+        uint64_t before = m_words[word];
+        TinyBitField::bitClr(bit);
+        if (before == ~(uint64_t)0) { markFull(word, false); }
+        if (m_words[word] == 0) { markAny(word, false); }
+    }
+
+    // Set the lowest clear bit and return it, capacity() if the field is full.
+    SIZETYPE allocate() {
+        SIZETYPE bit = findFirstClear();
+        bitSet(bit);
+        return bit;
+    }
+    void release(SIZETYPE bit) { bitClr(bit); }
+
+    SIZETYPE findFirstSet(SIZETYPE from = 0) const { return search(from, false); }
+    SIZETYPE findFirstClear(SIZETYPE from = 0) const { return search(from, true); }
+    SIZETYPE findNextSet(SIZETYPE bit) const { return (bit < m_capacity) ? search(bit + 1, false) : m_capacity; }
+
+protected:
+    uint64_t levelWord(uint32_t level, SIZETYPE word, bool clear) const {
+        if (level == 0) { return TinyBitWord::bits(m_words[word]); }
+        return clear ? m_full[level][word] : m_any[level][word];
+    }
+    // Go up until a summary word has a candidate after 'from', then follow the summaries down.
+    SIZETYPE search(SIZETYPE from, bool clear) const {
+        if (from >= m_capacity) { return m_capacity; }
+        uint64_t flip = clear ? ~(uint64_t)0 : 0;
+        SIZETYPE pos = from;
+        for (uint32_t level = 0; level <= m_levels; ++level) {
+            SIZETYPE word = pos / 64;
+            if (word >= m_levelWords[level]) { return m_capacity; }
+            uint64_t bits = (levelWord(level, word, clear) ^ flip) & (~(uint64_t)0 << (pos % 64));
+            if (bits != 0) {
+                SIZETYPE index = word * 64 + TinyBitWord::ctz(bits);
+                while (level > 0) {
+                    --level;
+                    index = index * 64 + TinyBitWord::ctz(levelWord(level, index, clear) ^ flip);
+                }
+                return (index < m_capacity) ? index : m_capacity;
+            }
+            pos = word + 1;
+        }
+        return m_capacity;
+    }
+    // Update the summaries after the word 'index' of the bits changed, stop as soon as a level does not change.
+    void markFull(SIZETYPE index, bool full) {
+        for (uint32_t level = 1; level <= m_levels; ++level, index /= 64) {
+            uint64_t& word = m_full[level][index / 64];
+            bool wasFull = (word == ~(uint64_t)0);
+            if (full) { word |= (uint64_t)1 << (index % 64); } else { word &= ~((uint64_t)1 << (index % 64)); }
+            if (wasFull == (word == ~(uint64_t)0)) { break; }
+        }
+    }
+    void markAny(SIZETYPE index, bool any) {
+        for (uint32_t level = 1; level <= m_levels; ++level, index /= 64) {
+            uint64_t& word = m_any[level][index / 64];
+            bool wasEmpty = (word == 0);
+            if (any) { word |= (uint64_t)1 << (index % 64); } else { word &= ~((uint64_t)1 << (index % 64)); }
+            if (wasEmpty == (word == 0)) { break; }
+        }
+    }
+};
+
+/*****************************************************************************/
+/*                                                                           */
+/*                           class TinyThreadPool                            */
+/*        A fork-join pool: run() spreads tasks over the workers and the     */
+/*  calling thread, and returns when all of them are done. TINY_THREADS      */
+/*  only.                                                                    */
+/*                                                                           */
+/*****************************************************************************/
+
+#if defined(TINY_THREADS)
+class TinyThreadPool
+{
+protected:
+    std::vector<std::thread> m_workers;
+    std::mutex m_runLock;                   // One run() at a time.
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::function<void(uint32_t)> m_task;
+    uint32_t m_tasks;
+    uint32_t m_next;
+    uint32_t m_pending;
+    uint64_t m_generation;
+    bool m_stop;
+public:
+    // 'threads' counts the calling thread, so a pool of 1 runs everything inline.
+    TinyThreadPool(uint32_t threads = std::thread::hardware_concurrency())
+        : m_tasks(0), m_next(0), m_pending(0), m_generation(0), m_stop(false) {
+        for (uint32_t i = 1; i < threads; ++i) { m_workers.push_back(std::thread(&TinyThreadPool::loop, this)); }
+    }
+    ~TinyThreadPool() {
+        { std::lock_guard<std::mutex> lock(m_mutex); m_stop = true; }
+        m_wake.notify_all();
+        for (size_t i = 0; i < m_workers.size(); ++i) { m_workers[i].join(); }
+    }
+
+    uint32_t size() const { return (uint32_t)m_workers.size() + 1; }
+
+    void run(uint32_t tasks, const std::function<void(uint32_t)>& task) {
+        if (m_workers.empty() || (tasks <= 1)) {
+            for (uint32_t i = 0; i < tasks; ++i) { task(i); }
+            return;
+        }
+        std::lock_guard<std::mutex> running(m_runLock);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = task; m_tasks = tasks; m_next = 0; m_pending = tasks; ++m_generation;
+        }
+        m_wake.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_pending != 0) { m_done.wait(lock); }
+    }
+
+protected:
+    void work() {
+        for (;;) {
+            uint32_t index;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_next >= m_tasks) { return; }
+                index = m_next++;
+            }
+            m_task(index);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0) { m_done.notify_all(); }
+        }
+    }
+    void loop() {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (!m_stop && (m_generation == seen)) { m_wake.wait(lock); }
+                if (m_stop) { return; }
+                seen = m_generation;
+            }
+            work();
+        }
+    }
+};
+#endif
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                            struct TinyBitExpr                             */
+/*     Expression templates for BitField: a = (b & c) | ~d is one fused      */
+/*  pass over the words, with no temporary field. Like the in-place ops,     */
+/*  the result has the capacity of the left-most operand, and the words      */
+/*  beyond a shorter right operand are taken from the left one.              */
+/*                                                                           */
+/*****************************************************************************/
+
+class BitField;
+
+template< class E >
+struct TinyBitExpr
+{
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// Fields are held by reference, the nodes of a sub-expression by value.
+template< class E > struct TinyBitExprHold { typedef const E type; };
+template< > struct TinyBitExprHold< BitField > { typedef const BitField& type; };
+
+struct TinyBitAndOp { static uint64_t apply(uint64_t lhs, uint64_t rhs) { return lhs & rhs; } };
+struct TinyBitOrOp { static uint64_t apply(uint64_t lhs, uint64_t rhs) { return lhs | rhs; } };
+struct TinyBitXorOp { static uint64_t apply(uint64_t lhs, uint64_t rhs) { return lhs ^ rhs; } };
+
+// word() is for operands of the same capacity, wordMasked() handles mixed capacities.
+template< class L, class R, class OP >
+class TinyBitBinary : public TinyBitExpr< TinyBitBinary<L, R, OP> >
+{
+protected:
+    typename TinyBitExprHold<L>::type m_lhs;
+    typename TinyBitExprHold<R>::type m_rhs;
+public:
+    TinyBitBinary(const L& lhs, const R& rhs) : m_lhs(lhs), m_rhs(rhs) { }
+
+    SIZETYPE capacity() const { return m_lhs.capacity(); }
+    SIZETYPE wordCount() const { return m_lhs.wordCount(); }
+    bool uniform(SIZETYPE capacity) const { return m_lhs.uniform(capacity) && m_rhs.uniform(capacity); }
+    uint64_t word(SIZETYPE i) const { return OP::apply(m_lhs.word(i), m_rhs.word(i)); }
+    uint64_t wordMasked(SIZETYPE i) const {
+        uint64_t value = (i < m_rhs.wordCount()) ? OP::apply(m_lhs.wordMasked(i), m_rhs.wordMasked(i)) : m_lhs.wordMasked(i);
+        return (i + 1 == wordCount()) ? (value & TinyBitWord::tailMask(capacity())) : value;
+    }
+};
+
+template< class E >
+class TinyBitNot : public TinyBitExpr< TinyBitNot<E> >
+{
+protected:
+    typename TinyBitExprHold<E>::type m_operand;
+public:
+    TinyBitNot(const E& operand) : m_operand(operand) { }
+
+    SIZETYPE capacity() const { return m_operand.capacity(); }
+    SIZETYPE wordCount() const { return m_operand.wordCount(); }
+    bool uniform(SIZETYPE capacity) const { return m_operand.uniform(capacity); }
+    uint64_t word(SIZETYPE i) const { return ~m_operand.word(i); }
+    uint64_t wordMasked(SIZETYPE i) const {
+        uint64_t value = ~m_operand.wordMasked(i);
+        return (i + 1 == wordCount()) ? (value & TinyBitWord::tailMask(capacity())) : value;
+    }
+};
+
+template< class L, class R >
+TinyBitBinary<L, R, TinyBitAndOp> operator & (const TinyBitExpr<L>& lhs, const TinyBitExpr<R>& rhs) { return TinyBitBinary<L, R, TinyBitAndOp>(lhs.self(), rhs.self()); }
+template< class L, class R >
+TinyBitBinary<L, R, TinyBitOrOp> operator | (const TinyBitExpr<L>& lhs, const TinyBitExpr<R>& rhs) { return TinyBitBinary<L, R, TinyBitOrOp>(lhs.self(), rhs.self()); }
+template< class L, class R >
+TinyBitBinary<L, R, TinyBitXorOp> operator ^ (const TinyBitExpr<L>& lhs, const TinyBitExpr<R>& rhs) { return TinyBitBinary<L, R, TinyBitXorOp>(lhs.self(), rhs.self()); }
+template< class E >
+TinyBitNot<E> operator ~ (const TinyBitExpr<E>& operand) { return TinyBitNot<E>(operand.self()); }
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                              class BitField                               */
+/*                      Original design. Kind of heavy.                      */
+/*                Maybe we should remove it form Tiny Family.                */
+/*****************************************************************************/
+
+class BitField : public TinyBitField, public TinyBitExpr<BitField>
+{
+public:
+    BitField(SIZETYPE capacity) : TinyBitField(capacity){ }
+    BitField(const BitField& rhs) : TinyBitField(0) { operator=(rhs); }
+    BitField(BitField&& rhs) noexcept : TinyBitField() { swap(rhs); }
+    template< class E >
+    BitField(const TinyBitExpr<E>& expr) : TinyBitField(expr.self().capacity()) { evaluate(expr.self()); }
+    ~BitField() { }
+
+    BitField& operator=(const BitField& rhs) {
+        if (rhs.m_bitField != NULL) {
             init(rhs.m_capacity);
             memcpy(m_bitField, rhs.m_bitField, rhs.m_fieldlen);
         } else {
@@ -258,33 +1714,584 @@ public:
         }
         return *this;
     }
+    BitField& operator=(BitField&& rhs) noexcept { destroy(); swap(rhs); return *this; }
+    // Evaluated in place when the capacity does not change, so the field may appear in the expression.
+    template< class E >
+    BitField& operator=(const TinyBitExpr<E>& expr) {
+        if (expr.self().capacity() != m_capacity) { return operator=(BitField(expr)); }
+        evaluate(expr.self());
+        return *this;
+    }
+    template< class E > BitField& operator &= (const TinyBitExpr<E>& rhs) { return operator=(*this & rhs); }
+    template< class E > BitField& operator |= (const TinyBitExpr<E>& rhs) { return operator=(*this | rhs); }
+    template< class E > BitField& operator ^= (const TinyBitExpr<E>& rhs) { return operator=(*this ^ rhs); }
 
-    bool allZero() const { uint8_t sum = 0; for (SIZETYPE i = 0; i < m_fieldlen; ++i) { sum |= m_bitField[i]; } return sum == 0; }
-    void zeroAll() { for (SIZETYPE i = 0; i < m_fieldlen; ++i) { m_bitField[i] = 0; } }
+    void swap(BitField& rhs) noexcept {
+        std::swap(m_bitField, rhs.m_bitField); std::swap(m_capacity, rhs.m_capacity);
+        std::swap(m_fieldlen, rhs.m_fieldlen); std::swap(m_words, rhs.m_words); std::swap(m_wordlen, rhs.m_wordlen); std::swap(m_owned, rhs.m_owned);
+    }
+
+    bool allZero() const { return TinyBitOps::allZero(m_words, m_wordlen); }
+    void zeroAll() { memset(m_words, 0, m_fieldlen); }
 
     operator bool() const { return !allZero(); }
 
-    BitField& not() { for (SIZETYPE i = 0; i < m_capacity / 8 + 1; ++i) { m_bitField[i] = ~m_bitField[i]; } return *this; }
-    BitField& xor(const BitField& rhs) { forEachItem(do_xor, rhs); return *this; }
-    BitField& and(const BitField& rhs) { forEachItem(do_and, rhs); return *this; }
-    BitField& or (const BitField& rhs) { forEachItem(do_or, rhs); return *this; }
+    BitField& not() { TinyBitOps::opNot(m_words, m_wordlen); clearTail(); return *this; }
+    BitField& xor(const BitField& rhs) { TinyBitOps::opXor(m_words, rhs.m_words, minWords(rhs)); clearTail(); return *this; }
+    BitField& and(const BitField& rhs) { TinyBitOps::opAnd(m_words, rhs.m_words, minWords(rhs)); return *this; }
+    BitField& or (const BitField& rhs) { TinyBitOps::opOr(m_words, rhs.m_words, minWords(rhs)); clearTail(); return *this; }
+
+#if defined(TINY_THREADS)
+    // Parallel versions of the bulk ops, fields below PARALLEL_MIN_WORDS stay on the calling thread.
+    static const SIZETYPE PARALLEL_MIN_WORDS = 1 << 16;
+
+    BitField& parallelNot(TinyThreadPool& pool) {
+        parallel(pool, m_wordlen, [&](SIZETYPE begin, SIZETYPE end, uint32_t) { TinyBitOps::opNot(m_words + begin, end - begin); });
+        clearTail();
+        return *this;
+    }
+    BitField& parallelXor(const BitField& rhs, TinyThreadPool& pool) {
+        parallel(pool, minWords(rhs), [&](SIZETYPE begin, SIZETYPE end, uint32_t) { TinyBitOps::opXor(m_words + begin, rhs.m_words + begin, end - begin); });
+        clearTail();
+        return *this;
+    }
+    BitField& parallelAnd(const BitField& rhs, TinyThreadPool& pool) {
+        parallel(pool, minWords(rhs), [&](SIZETYPE begin, SIZETYPE end, uint32_t) { TinyBitOps::opAnd(m_words + begin, rhs.m_words + begin, end - begin); });
+        return *this;
+    }
+    BitField& parallelOr(const BitField& rhs, TinyThreadPool& pool) {
+        parallel(pool, minWords(rhs), [&](SIZETYPE begin, SIZETYPE end, uint32_t) { TinyBitOps::opOr(m_words + begin, rhs.m_words + begin, end - begin); });
+        clearTail();
+        return *this;
+    }
+    bool parallelAllZero(TinyThreadPool& pool) const {
+        std::vector<uint8_t> zero(pool.size(), 1);
+        parallel(pool, m_wordlen, [&](SIZETYPE begin, SIZETYPE end, uint32_t task) { zero[task] = TinyBitOps::allZero(m_words + begin, end - begin) ? 1 : 0; });
+        return std::find(zero.begin(), zero.end(), 0) == zero.end();
+    }
+    SIZETYPE parallelCount(TinyThreadPool& pool) const {
+        std::vector<SIZETYPE> counts(pool.size(), 0);
+        parallel(pool, m_wordlen, [&](SIZETYPE begin, SIZETYPE end, uint32_t task) {
+            SIZETYPE total = 0;
+            for (SIZETYPE i = begin; i < end; ++i) { total += TinyBitWord::popcount(m_words[i]); }
+            counts[task] = total;
+        });
+        SIZETYPE total = 0;
+        for (size_t i = 0; i < counts.size(); ++i) { total += counts[i]; }
+        return total;
+    }
+#endif
 
-    BitField& operator ~ () { return BitField(*this).not(); }
-    BitField& operator ^ (const BitField& rhs) { return BitField(*this).xor(rhs); }
-    BitField& operator & (const BitField& rhs) { return BitField(*this).and(rhs); }
-    BitField& operator | (const BitField& rhs) { return BitField(*this).or (rhs); }
+    // Leaf of TinyBitExpr.
+    using TinyBitField::capacity;
+    using TinyBitField::wordCount;
+    bool uniform(SIZETYPE capacity) const { return m_capacity == capacity; }
+    uint64_t word(SIZETYPE i) const { return m_words[i]; }
+    uint64_t wordMasked(SIZETYPE i) const { return m_words[i]; }
 
 protected:
     BitField& operator << (SIZETYPE offset) { return *this; }
     BitField& operator >> (SIZETYPE offset) { return *this; }
 protected:
-    void forEachItem(uint8_t(*calc)(uint8_t, uint8_t), const BitField& rhs) {
-        SIZETYPE minSize = (m_capacity / 8 + 1) < (rhs.m_capacity / 8 + 1) ? (m_capacity / 8 + 1) : (rhs.m_capacity / 8 + 1);
-        for (SIZETYPE i = 0; i < minSize; ++i) { m_bitField[i] = calc(m_bitField[i], rhs.m_bitField[i]); }
+    SIZETYPE minWords(const BitField& rhs) const { return (m_wordlen < rhs.m_wordlen) ? m_wordlen : rhs.m_wordlen; }
+
+#if defined(TINY_THREADS)
+    // One task per pool thread, each on a run of whole cache lines.
+    template< class F >
+    void parallel(TinyThreadPool& pool, SIZETYPE words, const F& f) const {
+        uint32_t tasks = (words < PARALLEL_MIN_WORDS) ? 1 : pool.size();
+        SIZETYPE step = ((words + tasks - 1) / tasks + 7) & ~(SIZETYPE)7;
+        pool.run(tasks, [&](uint32_t task) {
+            SIZETYPE begin = task * step;
+            SIZETYPE end = (begin + step < words) ? begin + step : words;
+            if (begin < end) { f(begin, end, task); }
+        });
+    }
+#endif
+
+    template< class E >
+    void evaluate(const E& expr) {
+        if (expr.uniform(m_capacity)) {
+            for (SIZETYPE i = 0; i < m_wordlen; ++i) { m_words[i] = expr.word(i); }
+        } else {
+            for (SIZETYPE i = 0; i < m_wordlen; ++i) { m_words[i] = expr.wordMasked(i); }
+        }
+        clearTail();
     }
-    static uint8_t do_or(uint8_t lhs, uint8_t rhs) { return lhs | rhs; }
-    static uint8_t do_xor(uint8_t lhs, uint8_t rhs) { return lhs ^ rhs; }
-    static uint8_t do_and(uint8_t lhs, uint8_t rhs) { return lhs & rhs; }
+};
+
+/*****************************************************************************/
+/*                                                                           */
+/*                         class CompressedBitField                          */
+/*        A roaring-style bit field, memory follows the set bits count.      */
+/*  The bits are split into 2^16-bit chunks, each stored as a sorted array,  */
+/*  a 1024-word bitset or a list of runs, whichever fits. Empty chunks take  */
+/*  no memory. Logical operations work chunk by chunk on the stored forms.   */
+/*  NOTE: bitSet/bitClr keep array or bitset form, call optimize() to turn   */
+/*        chunks that hold long ranges into runs. bitClr keeps a bitset      */
+/*        until ARRAY_MIN, so a bit flipping at ARRAY_MAX does not convert   */
+/*        back and forth; optimize() shrinks it earlier.                     */
+/*                                                                           */
+/*****************************************************************************/
+
+class CompressedBitField
+{
+public:
+    static const uint32_t CHUNK_BITS = 65536;
+    static const uint32_t CHUNK_WORDS = CHUNK_BITS / 64;
+    static const uint32_t ARRAY_MAX = 4096;         // An array bigger than this takes more memory than a bitset.
+    static const uint32_t ARRAY_MIN = ARRAY_MAX / 2;    // bitClr turns a bitset back into an array only at this.
+
+    enum ContainerType { CONTAINER_ARRAY, CONTAINER_BITSET, CONTAINER_RUN };
+
+    struct Container
+    {
+        SIZETYPE key;                               // bit / CHUNK_BITS
+        uint32_t type;
+        uint32_t cardinality;
+        std::vector<uint16_t> values;               // Array: sorted low bits. Run: pairs of (first, last).
+        std::vector<uint64_t> words;                // Bitset: CHUNK_WORDS words.
+    };
+protected:
+    std::vector<Container> m_chunks;                // Sorted by key, never holds an empty container.
+    SIZETYPE m_capacity;
+public:
+    CompressedBitField(SIZETYPE capacity) : m_capacity(capacity) { }
+    ~CompressedBitField() { }
+
+    SIZETYPE capacity() const { return m_capacity; }
+    SIZETYPE count() const {
+        SIZETYPE total = 0;
+        for (size_t i = 0; i < m_chunks.size(); ++i) { total += m_chunks[i].cardinality; }
+        return total;
+    }
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(*this) + m_chunks.capacity() * sizeof(Container);
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            bytes += m_chunks[i].values.capacity() * sizeof(uint16_t) + m_chunks[i].words.capacity() * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+
+    void bitSet(SIZETYPE bit) {
+        if (bit >= m_capacity) { return; }
+        size_t i = locate(bit / CHUNK_BITS);
+        if ((i == m_chunks.size()) || (m_chunks[i].key != bit / CHUNK_BITS)) {
+            m_chunks.insert(m_chunks.begin() + i, Container());
+            m_chunks[i].key = bit / CHUNK_BITS;
+            m_chunks[i].type = CONTAINER_ARRAY;
+            m_chunks[i].cardinality = 0;
+        }
+        add(m_chunks[i], (uint16_t)(bit % CHUNK_BITS));
+    }
+    void bitClr(SIZETYPE bit) {
+        if (bit >= m_capacity) { return; }
+        size_t i = locate(bit / CHUNK_BITS);
+        if ((i == m_chunks.size()) || (m_chunks[i].key != bit / CHUNK_BITS)) { return; }
+        remove(m_chunks[i], (uint16_t)(bit % CHUNK_BITS));
+        if (m_chunks[i].cardinality == 0) { m_chunks.erase(m_chunks.begin() + i); }
+    }
+    uint8_t bitGet(SIZETYPE bit) const { return bitCheck(bit) ? 1 : 0; }
+    bool bitCheck(SIZETYPE bit) const {
+        if (bit >= m_capacity) { return false; }
+        size_t i = locate(bit / CHUNK_BITS);
+        return (i < m_chunks.size()) && (m_chunks[i].key == bit / CHUNK_BITS) && contains(m_chunks[i], (uint16_t)(bit % CHUNK_BITS));
+    }
+
+    bool allZero() const { return m_chunks.empty(); }
+    void zeroAll() { m_chunks.clear(); }
+
+    operator bool() const { return !allZero(); }
+
+    // Form of the chunk that holds bit, an empty chunk counts as an empty array.
+    ContainerType chunkType(SIZETYPE bit) const {
+        size_t i = locate(bit / CHUNK_BITS);
+        return ((i < m_chunks.size()) && (m_chunks[i].key == bit / CHUNK_BITS)) ? (ContainerType)m_chunks[i].type : CONTAINER_ARRAY;
+    }
+
+    // Store every chunk in its smallest form.
+    void optimize() { for (size_t i = 0; i < m_chunks.size(); ++i) { optimize(m_chunks[i]); } }
+
+    CompressedBitField& not() {
+        std::vector<Container> result;
+        SIZETYPE chunks = m_capacity / CHUNK_BITS + ((m_capacity % CHUNK_BITS) ? 1 : 0);
+        size_t i = 0;
+        for (SIZETYPE key = 0; key < chunks; ++key) {
+            Container c;
+            if ((i < m_chunks.size()) && (m_chunks[i].key == key)) {
+                complement(m_chunks[i++], chunkLimit(key), c);
+            } else {
+                c.key = key; c.type = CONTAINER_RUN; c.cardinality = chunkLimit(key);
+                c.values.push_back(0); c.values.push_back((uint16_t)(chunkLimit(key) - 1));
+            }
+            if (c.cardinality != 0) { optimize(c); result.push_back(std::move(c)); }
+        }
+        m_chunks.swap(result);
+        return *this;
+    }
+    CompressedBitField& xor(const CompressedBitField& rhs) { return combine(rhs, OP_XOR); }
+    CompressedBitField& and(const CompressedBitField& rhs) { return combine(rhs, OP_AND); }
+    CompressedBitField& or (const CompressedBitField& rhs) { return combine(rhs, OP_OR); }
+
+    CompressedBitField operator ~ () const { return CompressedBitField(*this).not(); }
+    CompressedBitField operator ^ (const CompressedBitField& rhs) const { return CompressedBitField(*this).xor(rhs); }
+    CompressedBitField operator & (const CompressedBitField& rhs) const { return CompressedBitField(*this).and(rhs); }
+    CompressedBitField operator | (const CompressedBitField& rhs) const { return CompressedBitField(*this).or (rhs); }
+
+protected:
+    enum Operation { OP_AND, OP_OR, OP_XOR };
+
+    size_t locate(SIZETYPE key) const {
+        size_t low = 0, high = m_chunks.size();
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (m_chunks[mid].key < key) { low = mid + 1; } else { high = mid; }
+        }
+        return low;
+    }
+    uint32_t chunkLimit(SIZETYPE key) const {
+        SIZETYPE left = m_capacity - (SIZETYPE)key * CHUNK_BITS;
+        return (left < CHUNK_BITS) ? (uint32_t)left : CHUNK_BITS;
+    }
+
+    CompressedBitField& combine(const CompressedBitField& rhs, Operation op) {
+        std::vector<Container> result;
+        size_t i = 0, j = 0;
+        while ((i < m_chunks.size()) || (j < rhs.m_chunks.size())) {
+            bool left = (i < m_chunks.size()) && ((j == rhs.m_chunks.size()) || (m_chunks[i].key <= rhs.m_chunks[j].key));
+            bool right = (j < rhs.m_chunks.size()) && ((i == m_chunks.size()) || (rhs.m_chunks[j].key <= m_chunks[i].key));
+            if (left && right) {
+                result.push_back(Container());
+                if (op == OP_AND) { intersect(m_chunks[i], rhs.m_chunks[j], result.back()); }
+                else if (op == OP_OR) { unite(m_chunks[i], rhs.m_chunks[j], result.back()); }
+                else { symmetricDifference(m_chunks[i], rhs.m_chunks[j], result.back()); }
+                if (result.back().cardinality == 0) { result.pop_back(); }
+                ++i; ++j;
+            } else if (left) {
+                if (op != OP_AND) { result.push_back(std::move(m_chunks[i])); }
+                ++i;
+            } else {
+                if ((op != OP_AND) && ((SIZETYPE)rhs.m_chunks[j].key * CHUNK_BITS < m_capacity)) {
+                    result.push_back(rhs.m_chunks[j]);
+                    clip(result.back(), chunkLimit(result.back().key));
+                    if (result.back().cardinality == 0) { result.pop_back(); }
+                }
+                ++j;
+            }
+        }
+        m_chunks.swap(result);
+        if (!m_chunks.empty() && (m_chunks.back().key == (m_capacity - 1) / CHUNK_BITS)) {
+            clip(m_chunks.back(), chunkLimit(m_chunks.back().key));
+            if (m_chunks.back().cardinality == 0) { m_chunks.pop_back(); }
+        }
+        return *this;
+    }
+
+    static bool contains(const Container& c, uint16_t low) {
+        if (c.type == CONTAINER_ARRAY) { return std::binary_search(c.values.begin(), c.values.end(), low); }
+        if (c.type == CONTAINER_BITSET) { return (c.words[low / 64] >> (low % 64)) & 1; }
+        size_t first = 0, last = c.values.size() / 2;       // The last run that starts at or before 'low'.
+        while (first < last) {
+            size_t mid = (first + last) / 2;
+            if (c.values[mid * 2] <= low) { first = mid + 1; } else { last = mid; }
+        }
+        return (first > 0) && (low <= c.values[first * 2 - 1]);
+    }
+    static void add(Container& c, uint16_t low) {
+        if (c.type == CONTAINER_RUN) { toNatural(c); }
+        if (c.type == CONTAINER_ARRAY) {
+            std::vector<uint16_t>::iterator it = std::lower_bound(c.values.begin(), c.values.end(), low);
+            if ((it != c.values.end()) && (*it == low)) { return; }
+            c.values.insert(it, low);
+            if (++c.cardinality > ARRAY_MAX) { toNatural(c); }
+        } else {
+            uint64_t mask = (uint64_t)1 << (low % 64);
+            if ((c.words[low / 64] & mask) == 0) { c.words[low / 64] |= mask; ++c.cardinality; }
+        }
+    }
+    static void remove(Container& c, uint16_t low) {
+        if (c.type == CONTAINER_RUN) { toNatural(c); }
+        if (c.type == CONTAINER_ARRAY) {
+            std::vector<uint16_t>::iterator it = std::lower_bound(c.values.begin(), c.values.end(), low);
+            if ((it == c.values.end()) || (*it != low)) { return; }
+            c.values.erase(it);
+            --c.cardinality;
+        } else {
+            uint64_t mask = (uint64_t)1 << (low % 64);
+            if ((c.words[low / 64] & mask) != 0) { c.words[low / 64] &= ~mask; --c.cardinality; }
+            if (c.cardinality <= ARRAY_MIN) { toNatural(c); }
+        }
+    }
+
+    // Render any form into CHUNK_WORDS words.
+    static void render(const Container& c, uint64_t* words) {
+        if (c.type == CONTAINER_BITSET) { memcpy(words, &c.words[0], CHUNK_WORDS * sizeof(uint64_t)); return; }
+        memset(words, 0, CHUNK_WORDS * sizeof(uint64_t));
+        if (c.type == CONTAINER_ARRAY) {
+            for (size_t i = 0; i < c.values.size(); ++i) { words[c.values[i] / 64] |= (uint64_t)1 << (c.values[i] % 64); }
+        } else {
+            for (size_t i = 0; i < c.values.size(); i += 2) { setRange(words, c.values[i], c.values[i + 1]); }
+        }
+    }
+    static void setRange(uint64_t* words, uint32_t first, uint32_t last) {
+        uint64_t firstMask = ~(uint64_t)0 << (first % 64);
+        uint64_t lastMask = ~(uint64_t)0 >> (63 - last % 64);
+        if (first / 64 == last / 64) { words[first / 64] |= firstMask & lastMask; return; }
+        words[first / 64] |= firstMask;
+        for (uint32_t w = first / 64 + 1; w < last / 64; ++w) { words[w] = ~(uint64_t)0; }
+        words[last / 64] |= lastMask;
+    }
+    // Store the words as an array or a bitset, depending on the cardinality.
+    static void assign(Container& c, const uint64_t* words) {
+        uint32_t cardinality = 0;
+        for (uint32_t w = 0; w < CHUNK_WORDS; ++w) { cardinality += TinyBitWord::popcount(words[w]); }
+        c.cardinality = cardinality;
+        std::vector<uint16_t>().swap(c.values);
+        if (cardinality > ARRAY_MAX) {
+            c.type = CONTAINER_BITSET;
+            c.words.assign(words, words + CHUNK_WORDS);
+            return;
+        }
+        c.type = CONTAINER_ARRAY;
+        std::vector<uint64_t>().swap(c.words);
+        c.values.reserve(cardinality);
+        for (uint32_t w = 0; w < CHUNK_WORDS; ++w) {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) { c.values.push_back((uint16_t)(w * 64 + TinyBitWord::ctz(bits))); }
+        }
+    }
+    static void toNatural(Container& c) {
+        uint64_t words[CHUNK_WORDS];
+        render(c, words);
+        assign(c, words);
+    }
+    static uint32_t countRuns(const Container& c) {
+        if (c.type == CONTAINER_RUN) { return (uint32_t)(c.values.size() / 2); }
+        uint32_t runs = 0;
+        if (c.type == CONTAINER_ARRAY) {
+            for (size_t i = 0; i < c.values.size(); ++i) { runs += ((i == 0) || (c.values[i] != c.values[i - 1] + 1)) ? 1 : 0; }
+            return runs;
+        }
+        for (uint32_t w = 0, carry = 0; w < CHUNK_WORDS; carry = (uint32_t)(c.words[w++] >> 63)) {
+            runs += TinyBitWord::popcount(c.words[w] & ~((c.words[w] << 1) | carry));
+        }
+        return runs;
+    }
+    static void optimize(Container& c) {
+        uint32_t runBytes = countRuns(c) * 2 * sizeof(uint16_t);
+        uint32_t naturalBytes = (c.cardinality > ARRAY_MAX) ? CHUNK_WORDS * sizeof(uint64_t) : c.cardinality * sizeof(uint16_t);
+        if (runBytes >= naturalBytes) {
+            if ((c.type == CONTAINER_RUN) || ((c.type == CONTAINER_BITSET) && (c.cardinality <= ARRAY_MAX))) { toNatural(c); }
+            return;
+        }
+        if (c.type == CONTAINER_RUN) { return; }
+        uint64_t words[CHUNK_WORDS];
+        render(c, words);
+        std::vector<uint16_t> runs;
+        runs.reserve(runBytes / sizeof(uint16_t));
+        for (uint32_t bit = next(words, 0, true); bit < CHUNK_BITS; ) {
+            uint32_t end = next(words, bit, false);
+            runs.push_back((uint16_t)bit);
+            runs.push_back((uint16_t)(end - 1));
+            bit = next(words, end, true);
+        }
+        c.type = CONTAINER_RUN;
+        c.values.swap(runs);
+        std::vector<uint64_t>().swap(c.words);
+    }
+    // The first bit at or after 'from' with the given value, CHUNK_BITS if none.
+    static uint32_t next(const uint64_t* words, uint32_t from, bool set) {
+        if (from >= CHUNK_BITS) { return CHUNK_BITS; }
+        uint64_t flip = set ? 0 : ~(uint64_t)0;
+        uint64_t bits = (words[from / 64] ^ flip) & (~(uint64_t)0 << (from % 64));
+        for (uint32_t w = from / 64; ; bits = words[w] ^ flip) {
+            if (bits != 0) { return w * 64 + TinyBitWord::ctz(bits); }
+            if (++w == CHUNK_WORDS) { return CHUNK_BITS; }
+        }
+    }
+    // Drop the bits at or above 'limit'.
+    static void clip(Container& c, uint32_t limit) {
+        if ((limit >= CHUNK_BITS) || (c.cardinality == 0)) { return; }
+        if ((c.type != CONTAINER_BITSET) && (c.values.back() < limit)) { return; }
+        uint64_t words[CHUNK_WORDS];
+        render(c, words);
+        maskTail(words, limit);
+        assign(c, words);
+    }
+    static void maskTail(uint64_t* words, uint32_t limit) {
+        if (limit % 64) { words[limit / 64] &= ~(uint64_t)0 >> (64 - limit % 64); }
+        for (uint32_t w = (limit + 63) / 64; w < CHUNK_WORDS; ++w) { words[w] = 0; }
+    }
+    static void complement(const Container& c, uint32_t limit, Container& out) {
+        out.key = c.key;
+        if (c.type == CONTAINER_BITSET) {
+            uint64_t words[CHUNK_WORDS];
+            for (uint32_t w = 0; w < CHUNK_WORDS; ++w) { words[w] = ~c.words[w]; }
+            maskTail(words, limit);
+            assign(out, words);
+            return;
+        }
+        // The gaps between the values or the runs become the runs of the result.
+        out.type = CONTAINER_RUN;
+        out.cardinality = 0;
+        uint32_t start = 0;
+        size_t step = (c.type == CONTAINER_RUN) ? 2 : 1;
+        for (size_t i = 0; i < c.values.size(); i += step) {
+            uint32_t first = c.values[i], last = c.values[i + step - 1];
+            if (first > start) { out.values.push_back((uint16_t)start); out.values.push_back((uint16_t)(first - 1)); out.cardinality += first - start; }
+            start = last + 1;
+        }
+        if (start < limit) { out.values.push_back((uint16_t)start); out.values.push_back((uint16_t)(limit - 1)); out.cardinality += limit - start; }
+    }
+
+    static void intersect(const Container& a, const Container& b, Container& out) {
+        out.key = a.key;
+        if ((a.type == CONTAINER_ARRAY) && (b.type == CONTAINER_ARRAY)) {
+            out.type = CONTAINER_ARRAY;
+            std::set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(out.values));
+            out.cardinality = (uint32_t)out.values.size();
+        } else if ((a.type == CONTAINER_ARRAY) || (b.type == CONTAINER_ARRAY)) {
+            const Container& array = (a.type == CONTAINER_ARRAY) ? a : b;
+            const Container& other = (a.type == CONTAINER_ARRAY) ? b : a;
+            out.type = CONTAINER_ARRAY;
+            for (size_t i = 0; i < array.values.size(); ++i) { if (contains(other, array.values[i])) { out.values.push_back(array.values[i]); } }
+            out.cardinality = (uint32_t)out.values.size();
+        } else if ((a.type == CONTAINER_RUN) && (b.type == CONTAINER_RUN)) {
+            out.type = CONTAINER_RUN;
+            out.cardinality = 0;
+            for (size_t i = 0, j = 0; (i < a.values.size()) && (j < b.values.size()); ) {
+                uint32_t first = std::max(a.values[i], b.values[j]);
+                uint32_t last = std::min(a.values[i + 1], b.values[j + 1]);
+                if (first <= last) { out.values.push_back((uint16_t)first); out.values.push_back((uint16_t)last); out.cardinality += last - first + 1; }
+                if (a.values[i + 1] < b.values[j + 1]) { i += 2; } else { j += 2; }
+            }
+        } else {
+            combineWords(a, b, out, OP_AND);
+        }
+    }
+    static void unite(const Container& a, const Container& b, Container& out) {
+        out.key = a.key;
+        if ((a.type == CONTAINER_ARRAY) && (b.type == CONTAINER_ARRAY) && (a.cardinality + b.cardinality <= ARRAY_MAX)) {
+            out.type = CONTAINER_ARRAY;
+            std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(out.values));
+            out.cardinality = (uint32_t)out.values.size();
+        } else if ((a.type == CONTAINER_RUN) && (b.type == CONTAINER_RUN)) {
+            out.type = CONTAINER_RUN;
+            out.cardinality = 0;
+            for (size_t i = 0, j = 0; (i < a.values.size()) || (j < b.values.size()); ) {
+                const uint16_t* run = ((j == b.values.size()) || ((i < a.values.size()) && (a.values[i] <= b.values[j]))) ? &a.values[(i += 2) - 2] : &b.values[(j += 2) - 2];
+                if (!out.values.empty() && ((uint32_t)run[0] <= (uint32_t)out.values.back() + 1)) {
+                    if (run[1] > out.values.back()) { out.cardinality += run[1] - out.values.back(); out.values.back() = run[1]; }
+                } else {
+                    out.values.push_back(run[0]); out.values.push_back(run[1]); out.cardinality += run[1] - run[0] + 1;
+                }
+            }
+        } else {
+            combineWords(a, b, out, OP_OR);
+        }
+    }
+    static void symmetricDifference(const Container& a, const Container& b, Container& out) {
+        out.key = a.key;
+        if ((a.type == CONTAINER_ARRAY) && (b.type == CONTAINER_ARRAY) && (a.cardinality + b.cardinality <= ARRAY_MAX)) {
+            out.type = CONTAINER_ARRAY;
+            std::set_symmetric_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(out.values));
+            out.cardinality = (uint32_t)out.values.size();
+        } else {
+            combineWords(a, b, out, OP_XOR);
+        }
+    }
+    // Fallback for mixed forms: work on the rendered words.
+    static void combineWords(const Container& a, const Container& b, Container& out, Operation op) {
+        uint64_t lhs[CHUNK_WORDS], rhs[CHUNK_WORDS];
+        render(a, lhs);
+        render(b, rhs);
+        if (op == OP_AND) { TinyBitOps::opAnd(lhs, rhs, CHUNK_WORDS); }
+        else if (op == OP_OR) { TinyBitOps::opOr(lhs, rhs, CHUNK_WORDS); }
+        else { TinyBitOps::opXor(lhs, rhs, CHUNK_WORDS); }
+        assign(out, lhs);
+    }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                  class TinyStringTable / TinyStringIndex                  */
+/*   Indices of string keys known at build time, resolved by the compiler.   */
+/*  Key i of a table has index i, TINY_STRING_KEY makes it a constant and    */
+/*  fails to compile for an unknown key. TinyStringIndex interns the table   */
+/*  first, so dynamic keys continue the same index space at runtime.         */
+/*                                                                           */
+/*****************************************************************************/
+
+class TinyStringTable
+{
+protected:
+    const char* const* m_keys;
+    uint32_t m_count;
+
+    static constexpr bool equal(const char* a, const char* b) {
+        return (*a == *b) && ((*a == '\0') || equal(a + 1, b + 1));
+    }
+    // Halving keeps the constexpr recursion depth at log2 of the key count
+    constexpr int32_t find(const char* key, uint32_t lo, uint32_t hi) const {
+        return (hi - lo == 0) ? -1
+            : (hi - lo == 1) ? (equal(m_keys[lo], key) ? (int32_t)lo : -1)
+            : either(find(key, lo, lo + (hi - lo) / 2), key, lo + (hi - lo) / 2, hi);
+    }
+    constexpr int32_t either(int32_t first, const char* key, uint32_t lo, uint32_t hi) const {
+        return (first >= 0) ? first : find(key, lo, hi);
+    }
+    constexpr bool distinct(uint32_t lo, uint32_t hi) const {
+        return (hi - lo == 0) ? true
+            : (hi - lo == 1) ? (find(m_keys[lo], 0, m_count) == (int32_t)lo)
+            : (distinct(lo, lo + (hi - lo) / 2) && distinct(lo + (hi - lo) / 2, hi));
+    }
+    // Not constexpr on purpose: reaching it while folding TINY_STRING_KEY is a compile error
+    static int32_t unknownKey() { return -1; }
+    static constexpr int32_t known(int32_t index) { return (index >= 0) ? index : unknownKey(); }
+public:
+    template< uint32_t N >
+    constexpr TinyStringTable(const char* const (&keys)[N]) : m_keys(keys), m_count(N) { }
+
+    constexpr uint32_t size() const { return m_count; }
+    constexpr const char* str(uint32_t index) const { return (index < m_count) ? m_keys[index] : NULL; }
+    constexpr int32_t index(const char* key) const { return find(key, 0, m_count); }
+    constexpr int32_t require(const char* key) const { return known(index(key)); }
+    // For static_assert, a repeated key would have two indices
+    constexpr bool unique() const { return distinct(0, m_count); }
+
+    // Puts the keys in order, true if each got its table index
+    bool intern(struct string_index_context* ctx) const {
+        for (uint32_t i = 0; i < m_count; ++i) {
+            if (string_index_put(ctx, m_keys[i]) != (int32_t)i) { return false; }
+        }
+        return true;
+    }
+};
+
+#define TINY_STRING_KEY(table, key) (std::integral_constant< int32_t, (table).require(key) >::value)
+
+class TinyStringIndex
+{
+protected:
+    struct string_index_context m_ctx;
+    uint8_t* m_buffer;
+    bool m_consistent;
+public:
+    TinyStringIndex(const TinyStringTable& table, uint32_t maxCount, uint32_t arenaLen) {
+        uint32_t len = STRING_INDEX_CONTEXT_SIZE(maxCount, arenaLen);
+        m_buffer = new uint8_t[len];
+        m_consistent = (string_index_init(&m_ctx, m_buffer, len, maxCount) == 0) && table.intern(&m_ctx);
+    }
+    TinyStringIndex(const TinyStringIndex&) = delete;
+    TinyStringIndex& operator=(const TinyStringIndex&) = delete;
+    ~TinyStringIndex() { delete[] m_buffer; m_buffer = NULL; }
+
+    // False if the table did not fit, then its keys and indices disagree
+    bool consistent() const { return m_consistent; }
+    int32_t index(const char* str) { return string_index_put(&m_ctx, str); }
+    int32_t find(const char* str) const { return string_index_find(&m_ctx, str); }
+    const char* str(int32_t index) const { return string_index_str(&m_ctx, index); }
+    struct string_index_context* context() { return &m_ctx; }
 };
 
 
@@ -318,3 +2325,4 @@ struct TinyMask
     bool maskCheck(uint32_t mask) { return (m_mask & mask) != 0; }
 };
 
+#endif // _TINY_FAMILY_SLEEPY_H_
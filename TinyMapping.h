@@ -0,0 +1,583 @@
+#ifndef _TINY_MAPPING_SLEEPY_H_
+#define _TINY_MAPPING_SLEEPY_H_
+
+#include "TinyFamily.h"
+#include <new>
+#include <chrono>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+#endif
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                           class TinyFileMapping                           */
+/*              Map a file into memory for reading and writing.              */
+/*  The pages are shared with the file, so what the process wrote survives   */
+/*  when it crashes. sync() is only needed against a power loss.             */
+/*                                                                           */
+/*****************************************************************************/
+
+class TinyFileMapping
+{
+protected:
+    uint8_t* m_data;
+    uint64_t m_size;
+#if defined(_WIN32)
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+public:
+#if defined(_WIN32)
+    TinyFileMapping() : m_data(NULL), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(NULL) { }
+#else
+    TinyFileMapping() : m_data(NULL), m_size(0) { }
+#endif
+    TinyFileMapping(const TinyFileMapping&) = delete;
+    TinyFileMapping& operator=(const TinyFileMapping&) = delete;
+    ~TinyFileMapping() { close(); }
+
+    // Map 'size' bytes, a missing or shorter file is created or grown with zeros. Size 0 maps the whole existing file.
+    bool open(const char* path, uint64_t size) {
+        close();
+#if defined(_WIN32)
+        m_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, (size > 0) ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER current;
+        if ((m_file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(m_file, &current)) { close(); return false; }
+        if (size == 0) { size = (uint64_t)current.QuadPart; }
+        if (size == 0) { close(); return false; }
+        m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, NULL);
+        if (m_mapping == NULL) { close(); return false; }
+        m_data = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+        if (m_data == NULL) { close(); return false; }
+        m_size = size;
+        return true;
+#else
+        return mapDescriptor(::open(path, (size > 0) ? (O_RDWR | O_CREAT) : O_RDWR, 0644), size);
+#endif
+    }
+    // Same for a named shared memory object, which lives until unlinkShared() or the last user is gone.
+    bool openShared(const char* name, uint64_t size) {
+        close();
+#if defined(_WIN32)
+        if (size > 0) {
+            m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, name);
+        } else {
+            m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+        }
+        if (m_mapping == NULL) { return false; }
+        m_data = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+        MEMORY_BASIC_INFORMATION info;
+        if ((m_data == NULL) || (VirtualQuery(m_data, &info, sizeof(info)) == 0)) { close(); return false; }
+        m_size = (size > 0) ? size : (uint64_t)info.RegionSize;
+        return true;
+#else
+        return mapDescriptor(shm_open(name, (size > 0) ? (O_RDWR | O_CREAT) : O_RDWR, 0600), size);
+#endif
+    }
+    static bool unlinkShared(const char* name) {
+#if defined(_WIN32)
+        return name != NULL;
+#else
+        return shm_unlink(name) == 0;
+#endif
+    }
+    void close() {
+#if defined(_WIN32)
+        if (m_data != NULL) { UnmapViewOfFile(m_data); }
+        if (m_mapping != NULL) { CloseHandle(m_mapping); m_mapping = NULL; }
+        if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); m_file = INVALID_HANDLE_VALUE; }
+#else
+        if (m_data != NULL) { munmap(m_data, (size_t)m_size); }
+#endif
+        m_data = NULL; m_size = 0;
+    }
+    bool sync() {
+        if (m_data == NULL) { return false; }
+#if defined(_WIN32)
+        return FlushViewOfFile(m_data, 0) && ((m_file == INVALID_HANDLE_VALUE) || FlushFileBuffers(m_file));
+#else
+        return msync(m_data, (size_t)m_size, MS_SYNC) == 0;
+#endif
+    }
+
+    bool opened() const { return m_data != NULL; }
+    uint8_t* data() const { return m_data; }
+    uint64_t size() const { return m_size; }
+
+#if !defined(_WIN32)
+protected:
+    // Takes over 'fd' and closes it, the mapping stays valid without it.
+    bool mapDescriptor(int fd, uint64_t size) {
+        struct stat st;
+        if ((fd < 0) || (fstat(fd, &st) != 0)) { if (fd >= 0) { ::close(fd); } return false; }
+        if (size == 0) { size = (uint64_t)st.st_size; }
+        if ((size == 0) || (((uint64_t)st.st_size < size) && (ftruncate(fd, (off_t)size) != 0))) { ::close(fd); return false; }
+        void* data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) { return false; }
+        m_data = (uint8_t*)data;
+        m_size = size;
+        return true;
+    }
+#endif
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                          struct TinyMappedHeader                          */
+/*        The first 64 bytes of a mapped file, describing what follows.      */
+/*  A new file is all zeros, the magic is written last, so a file whose      */
+/*  creation was interrupted is simply created again.                        */
+/*                                                                           */
+/*****************************************************************************/
+
+#define TINY_MAPPING_MAGIC 0x594E4954u      // "TINY"
+#define TINY_MAPPING_VERSION 1
+
+enum TinyMappedKind { TINY_MAPPED_RING = 1, TINY_MAPPED_BITS = 2, TINY_MAPPED_SHARED_RING = 3 };
+
+struct TinyMappedHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;
+    uint32_t elementSize;                   // sizeof(T) of a ring, 0 for bits.
+    uint64_t capacity;                      // Ring slots or bits.
+    uint8_t reserved[40];
+
+    // Stamp a new header or check an existing one, capacity 0 accepts the stored capacity.
+    bool attach(uint32_t expectKind, uint32_t expectElementSize, uint64_t expectCapacity, bool& fresh) {
+        fresh = (magic == 0);
+        if (fresh) {
+            if (expectCapacity == 0) { return false; }
+            version = TINY_MAPPING_VERSION; kind = expectKind; elementSize = expectElementSize; capacity = expectCapacity;
+            std::atomic_thread_fence(std::memory_order_release);
+            magic = TINY_MAPPING_MAGIC;
+            return true;
+        }
+        return (magic == TINY_MAPPING_MAGIC) && (version == TINY_MAPPING_VERSION) && (kind == expectKind)
+            && (elementSize == expectElementSize) && ((expectCapacity == 0) || (capacity == expectCapacity));
+    }
+};
+
+static_assert(sizeof(TinyMappedHeader) == 64, "TinyMappedHeader must stay 64 bytes.");
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                         class TinyFileRingBuffer                          */
+/*         A TinySpscRingBufferShell whose slots and cursors are a file.     */
+/*  Layout: header | cursors | slots. A slot is published by the release     */
+/*  store of writePos after it is written, so a writer killed at any point   */
+/*  leaves only whole elements readable, and a new process resumes from the  */
+/*  persisted cursors.                                                       */
+/*  NOTE: T must be trivially copyable, the file holds its raw bytes.        */
+/*                                                                           */
+/*****************************************************************************/
+
+template< class T >
+class TinyFileRingBuffer : public TinySpscRingBufferShell< T >
+{
+protected:
+    TinyFileMapping m_mapping;
+public:
+    static const uint64_t CURSORS_OFFSET = sizeof(TinyMappedHeader);
+    static const uint64_t SLOTS_OFFSET = CURSORS_OFFSET + sizeof(TinySpscCursors);
+
+    TinyFileRingBuffer() { }
+    ~TinyFileRingBuffer() { close(); }
+
+    static uint64_t fileSize(SIZETYPE capacity) { return SLOTS_OFFSET + (uint64_t)capacity * sizeof(T); }
+
+    // Create the file with 'capacity' slots, or resume an existing one (capacity 0 takes what the file has).
+    bool open(const char* path, SIZETYPE capacity = 0) {
+        close();
+        if (!m_mapping.open(path, (capacity > 0) ? fileSize(capacity) : 0)) { return false; }
+        if (m_mapping.size() < SLOTS_OFFSET) { m_mapping.close(); return false; }
+
+        TinyMappedHeader* header = (TinyMappedHeader*)m_mapping.data();
+        TinySpscCursors* cursors = (TinySpscCursors*)(m_mapping.data() + CURSORS_OFFSET);
+        bool fresh = (header->magic == 0);
+        if (fresh) { new (cursors) TinySpscCursors(); }
+        if (!header->attach(TINY_MAPPED_RING, sizeof(T), capacity, fresh) || (m_mapping.size() < fileSize((SIZETYPE)header->capacity))) {
+            m_mapping.close();
+            return false;
+        }
+        this->init((T*)(m_mapping.data() + SLOTS_OFFSET), (SIZETYPE)header->capacity, cursors);
+        return true;
+    }
+    void close() {
+        m_mapping.close();
+        this->m_buffer = NULL; this->m_length = 0; this->m_cursors = NULL;
+    }
+    bool sync() { return m_mapping.sync(); }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                          class TinyFileBitField                           */
+/*          A TinyBitField whose words are a file, loaded by mapping.        */
+/*  Layout: header | words. Reopening maps the file again, nothing is read   */
+/*  or parsed, the pages come in when they are touched.                      */
+/*                                                                           */
+/*****************************************************************************/
+
+class TinyFileBitField : public TinyBitField
+{
+protected:
+    TinyFileMapping m_mapping;
+public:
+    static const uint64_t WORDS_OFFSET = sizeof(TinyMappedHeader);
+
+    TinyFileBitField() { }
+    ~TinyFileBitField() { close(); }
+
+    static uint64_t fileSize(SIZETYPE capacity) { return WORDS_OFFSET + (uint64_t)(capacity / 64 + ((capacity % 64) ? 1 : 0)) * 8; }
+
+    // Create the file with 'capacity' bits, or reload an existing one (capacity 0 takes what the file has).
+    bool open(const char* path, SIZETYPE capacity = 0) {
+        close();
+        if (!m_mapping.open(path, (capacity > 0) ? fileSize(capacity) : 0)) { return false; }
+        if (m_mapping.size() < WORDS_OFFSET) { m_mapping.close(); return false; }
+
+        TinyMappedHeader* header = (TinyMappedHeader*)m_mapping.data();
+        bool fresh;
+        if (!header->attach(TINY_MAPPED_BITS, 0, capacity, fresh) || (m_mapping.size() < fileSize((SIZETYPE)header->capacity))) {
+            m_mapping.close();
+            return false;
+        }
+        return attach((uint64_t*)(m_mapping.data() + WORDS_OFFSET), (SIZETYPE)header->capacity);
+    }
+    void close() { destroy(); m_mapping.close(); }
+    bool sync() { return m_mapping.sync(); }
+};
+
+/*****************************************************************************/
+/*                                                                           */
+/*                              struct TinyFutex                             */
+/*      Sleep on a 32-bit word in shared memory until another process        */
+/*  changes it. Linux uses the futex syscall, other systems poll.            */
+/*                                                                           */
+/*****************************************************************************/
+
+struct TinyFutex
+{
+    // Returns when *word is not 'expected', on a wake, or after timeoutMs (negative waits forever).
+    static void wait(std::atomic<uint32_t>* word, uint32_t expected, int32_t timeoutMs) {
+#if defined(__linux__)
+        struct timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, (timeoutMs >= 0) ? &timeout : NULL, NULL, 0);
+#else
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (word->load(std::memory_order_acquire) == expected) {
+            if ((timeoutMs >= 0) && (std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(timeoutMs))) { return; }
+            std::this_thread::yield();
+        }
+#endif
+    }
+    static void wakeAll(std::atomic<uint32_t>* word) {
+#if defined(__linux__)
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+        (void)word;
+#endif
+    }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                        class TinySharedRingBuffer                         */
+/*        A TinySpscRingBufferShell in named shared memory, for handing      */
+/*  data from one producer process to one consumer process without a copy    */
+/*  through the kernel. Layout: header | cursors | signals | slots.          */
+/*  A side that has to wait announces it in the signals, and the other side  */
+/*  bumps the sequence word and wakes it only then. In blocking mode put/get */
+/*  and write/read wait for space or data, otherwise they return at once.    */
+/*  NOTE: T must be trivially copyable, both processes see the same bytes.   */
+/*                                                                           */
+/*****************************************************************************/
+
+struct TinySharedSignals
+{
+    alignas(TINY_CACHE_LINE_SIZE) std::atomic< uint32_t > dataSeq;          // Bumped by the producer
+    std::atomic< uint32_t > consumerWaiting;
+    alignas(TINY_CACHE_LINE_SIZE) std::atomic< uint32_t > spaceSeq;         // Bumped by the consumer
+    std::atomic< uint32_t > producerWaiting;
+
+    TinySharedSignals() : dataSeq(0), consumerWaiting(0), spaceSeq(0), producerWaiting(0) { }
+};
+
+template< class T >
+class TinySharedRingBuffer : public TinySpscRingBufferShell< T >
+{
+protected:
+    typedef TinySpscRingBufferShell< T > Shell;
+
+    TinyFileMapping m_mapping;
+    TinySharedSignals* m_signals;
+    bool m_blocking;
+public:
+    static const uint64_t CURSORS_OFFSET = sizeof(TinyMappedHeader);
+    static const uint64_t SIGNALS_OFFSET = CURSORS_OFFSET + sizeof(TinySpscCursors);
+    static const uint64_t SLOTS_OFFSET = SIGNALS_OFFSET + sizeof(TinySharedSignals);
+
+    TinySharedRingBuffer() : m_signals(NULL), m_blocking(true) { }
+    ~TinySharedRingBuffer() { close(); }
+
+    static uint64_t memorySize(SIZETYPE capacity) { return SLOTS_OFFSET + (uint64_t)capacity * sizeof(T); }
+
+    // The owner creates the ring, starting empty even if the name was left over from an earlier run.
+    bool create(const char* name, SIZETYPE capacity) {
+        close();
+        if ((capacity == 0) || !m_mapping.openShared(name, memorySize(capacity))) { return false; }
+        TinyMappedHeader* header = (TinyMappedHeader*)m_mapping.data();
+        header->magic = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        new (m_mapping.data() + CURSORS_OFFSET) TinySpscCursors();
+        new (m_mapping.data() + SIGNALS_OFFSET) TinySharedSignals();
+        bool fresh;
+        header->attach(TINY_MAPPED_SHARED_RING, sizeof(T), capacity, fresh);
+        return bind();
+    }
+    // The other side opens it, this fails until create() is done.
+    bool open(const char* name) {
+        close();
+        if (!m_mapping.openShared(name, 0)) { return false; }
+        bool fresh;
+        TinyMappedHeader* header = (TinyMappedHeader*)m_mapping.data();
+        if ((m_mapping.size() < SLOTS_OFFSET) || !header->attach(TINY_MAPPED_SHARED_RING, sizeof(T), 0, fresh)
+            || (m_mapping.size() < memorySize((SIZETYPE)header->capacity))) {
+            m_mapping.close();
+            return false;
+        }
+        return bind();
+    }
+    void close() {
+        m_mapping.close();
+        this->m_buffer = NULL; this->m_length = 0; this->m_cursors = NULL; m_signals = NULL;
+    }
+    static bool unlink(const char* name) { return TinyFileMapping::unlinkShared(name); }
+
+    void setBlocking(bool blocking) { m_blocking = blocking; }
+    bool blocking() const { return m_blocking; }
+
+    // Producer side
+    // Retries through offer(), so a blocking put that waits is not counted as rejected.
+    bool put(const T& val) {
+        while (!this->offer(val)) {
+            if (!m_blocking) { this->count(this->m_rejected, 1); return false; }
+            waitWritable(-1);
+        }
+        notify(m_signals->dataSeq, m_signals->consumerWaiting);
+        return true;
+    }
+    SIZETYPE write(const T* data, SIZETYPE n) {
+        for (SIZETYPE done = 0; ; ) {
+            SIZETYPE written = this->offer(data + done, n - done);
+            if (written > 0) { notify(m_signals->dataSeq, m_signals->consumerWaiting); done += written; }
+            if (done == n) { return done; }
+            if (!m_blocking) { this->count(this->m_rejected, n - done); return done; }
+            waitWritable(-1);
+        }
+    }
+    bool waitWritable(int32_t timeoutMs) { return wait(m_signals->spaceSeq, m_signals->producerWaiting, false, timeoutMs); }
+
+    // Consumer side
+    bool get(T& val) {
+        while (!Shell::get(val)) {
+            if (!m_blocking) { return false; }
+            waitReadable(-1);
+        }
+        notify(m_signals->spaceSeq, m_signals->producerWaiting);
+        return true;
+    }
+    // Blocking mode waits for at least one element, then takes what is there up to n.
+    SIZETYPE read(T* data, SIZETYPE n) {
+        for (;;) {
+            SIZETYPE readed = Shell::read(data, n);
+            if (readed > 0) { notify(m_signals->spaceSeq, m_signals->producerWaiting); return readed; }
+            if ((n == 0) || !m_blocking) { return 0; }
+            waitReadable(-1);
+        }
+    }
+    bool waitReadable(int32_t timeoutMs) { return wait(m_signals->dataSeq, m_signals->consumerWaiting, true, timeoutMs); }
+
+protected:
+    bool bind() {
+        m_signals = (TinySharedSignals*)(m_mapping.data() + SIGNALS_OFFSET);
+        this->init((T*)(m_mapping.data() + SLOTS_OFFSET), (SIZETYPE)((TinyMappedHeader*)m_mapping.data())->capacity,
+            (TinySpscCursors*)(m_mapping.data() + CURSORS_OFFSET));
+        return true;
+    }
+    bool ready(bool readable) { return readable ? !this->end() : !this->full(); }
+    // Announce the wait, then check again: the fences pair with notify() so that either
+    // this check sees the other side's update or the other side sees the announcement.
+    bool wait(std::atomic< uint32_t >& seq, std::atomic< uint32_t >& waiting, bool readable, int32_t timeoutMs) {
+        uint32_t current = seq.load(std::memory_order_acquire);
+        waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = ready(readable);
+        if (!ok) {
+            TinyFutex::wait(&seq, current, timeoutMs);
+            ok = ready(readable);
+        }
+        waiting.store(0, std::memory_order_relaxed);
+        return ok;
+    }
+    void notify(std::atomic< uint32_t >& seq, std::atomic< uint32_t >& waiting) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) != 0) {
+            seq.fetch_add(1, std::memory_order_release);
+            TinyFutex::wakeAll(&seq);
+        }
+    }
+};
+
+
+/*****************************************************************************/
+/*                                                                           */
+/*                     class TinyMirroredCircularBuffer                      */
+/*     The TinyCircularBuffer API over pages mapped twice, back to back.     */
+/*  Byte i and byte i + capacity are the same memory, so any readable or     */
+/*  writable region is one pointer range and access() needs no modulo:       */
+/*  the read cursor is kept below capacity, the write cursor below twice     */
+/*  capacity. acquireRead/reserveWrite return an empty second span.          */
+/*  Linux only (memfd_create), create() fails elsewhere; MCU and portable    */
+/*  builds keep TinyCircularBuffer. Capacity is rounded up to whole pages.   */
+/*                                                                           */
+/*****************************************************************************/
+
+// A slot is the position itself, valid while the cursors stay inside the doubled mapping.
+struct TinyMirrorIndex
+{
+    static SIZETYPE slot(uint64_t pos, SIZETYPE) { return (SIZETYPE)pos; }
+};
+
+class TinyMirroredCircularBuffer : public TinyRingBufferShell< uint8_t, TinyMirrorIndex >
+{
+protected:
+    typedef TinyRingBufferShell< uint8_t, TinyMirrorIndex > Shell;
+
+    uint8_t* m_data;
+    SIZETYPE m_size;
+    uint64_t m_rPos;
+    uint64_t m_wPos;
+
+public:
+    TinyMirroredCircularBuffer() : m_data(NULL), m_size(0), m_rPos(0), m_wPos(0) { init(NULL, 0, &m_rPos, &m_wPos); }
+    TinyMirroredCircularBuffer(const TinyMirroredCircularBuffer&) = delete;
+    TinyMirroredCircularBuffer& operator=(const TinyMirroredCircularBuffer&) = delete;
+    virtual ~TinyMirroredCircularBuffer() { close(); }
+
+    bool create(SIZETYPE size) {
+        close();
+#if defined(__linux__)
+        uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+        uint64_t bytes = ((uint64_t)size + page - 1) / page * page;
+        if ((size == 0) || ((SIZETYPE)(2 * bytes) != 2 * bytes)) { return false; }
+        int fd = memfd_create("TinyMirroredCircularBuffer", MFD_CLOEXEC);
+        if ((fd < 0) || (ftruncate(fd, (off_t)bytes) != 0)) { if (fd >= 0) { ::close(fd); } return false; }
+        // Reserve both halves first so nothing else can be mapped in between.
+        uint8_t* data = (uint8_t*)mmap(NULL, (size_t)(2 * bytes), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        bool mapped = (data != (uint8_t*)MAP_FAILED)
+            && (mmap(data, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED)
+            && (mmap(data + bytes, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED);
+        ::close(fd);
+        if (!mapped) { if (data != (uint8_t*)MAP_FAILED) { munmap(data, (size_t)(2 * bytes)); } return false; }
+        m_data = data; m_size = (SIZETYPE)bytes; m_rPos = 0; m_wPos = 0;
+        init(m_data, m_size, &m_rPos, &m_wPos);
+        resetStats();
+        return true;
+#else
+        return false;
+#endif
+    }
+    void close() {
+#if defined(__linux__)
+        if (m_data != NULL) { munmap(m_data, 2 * (size_t)m_size); }
+#endif
+        m_data = NULL; m_size = 0; m_rPos = 0; m_wPos = 0;
+        init(NULL, 0, &m_rPos, &m_wPos);
+    }
+    bool created() const { return m_data != NULL; }
+
+    using Shell::peek;
+
+    // Only the unread bytes and the free space can be poked, the shell's poke() has no modulo to
+    // keep it inside the mapping here. Anything else is ignored.
+    void poke(int32_t offset, uint8_t val) {
+        uint64_t pos = m_wPos + offset;
+        if (created() && (pos - m_rPos < m_size)) { m_data[pos] = val; }
+    }
+
+    // Before create() succeeds there is no storage: puts and writes refuse, gets and reads find nothing.
+    bool put(uint8_t val) { if (!created()) { return false; } bool ok = Shell::put(val); rebase(); return ok; }
+    uint8_t get() { if (!created()) { return 0; } uint8_t val = Shell::get(); rebase(); return val; }
+
+    // Same contract as TinyCircularBuffer::write. The cursors move first, so the
+    // bytes that survive land in one range ending at the new write cursor.
+    SIZETYPE write(const uint8_t* buffer, SIZETYPE len) {
+        if (!created()) { return 0; }
+        len = admit(len);
+        m_wPos += len;
+        settle(len);
+        rebase();
+        SIZETYPE kept = (len < m_size) ? len : m_size;
+        memcpy(m_data + m_wPos - kept, buffer + len - kept, kept);
+        return len;
+    }
+    SIZETYPE read(uint8_t* buffer, SIZETYPE size) {
+        if (!created()) { return 0; }
+        SIZETYPE readed = peek(buffer, size, 0);
+        m_rPos += readed;
+        m_stats.totalOut += readed;
+        rebase();
+        return readed;
+    }
+    SIZETYPE peek(uint8_t* buffer, SIZETYPE len, SIZETYPE offset) {
+        SIZETYPE available = length();
+        if (offset >= available) { return 0; }
+        SIZETYPE peeked = (len < available - offset) ? len : (available - offset);
+        memcpy(buffer, m_data + m_rPos + offset, peeked);
+        return peeked;
+    }
+
+    // Zero-copy access as in the shell, the whole region is in first.
+    TinySpanPair< uint8_t > reserveWrite(SIZETYPE n) { SIZETYPE space = m_size - length(); return contiguous(m_wPos, (n < space) ? n : space); }
+    TinySpanPair< uint8_t > acquireRead() { return contiguous(m_rPos, length()); }
+    void releaseRead(SIZETYPE n) { Shell::releaseRead(n); rebase(); }
+
+protected:
+    TinySpanPair< uint8_t > contiguous(uint64_t pos, SIZETYPE len) const {
+        TinySpanPair< uint8_t > pair = { { m_data + pos, len }, { m_data, 0 } };
+        return pair;
+    }
+    // Keep the read cursor in the first copy; only a write longer than the buffer moves it by more than one turn.
+    void rebase() {
+        if ((m_size == 0) || (m_rPos < m_size)) { return; }
+        uint64_t turns = (m_rPos < 2 * (uint64_t)m_size) ? m_size : (m_rPos - m_rPos % m_size);
+        m_rPos -= turns; m_wPos -= turns;
+    }
+};
+
+
+#endif // _TINY_MAPPING_SLEEPY_H_
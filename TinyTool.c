@@ -1,15 +1,65 @@
 #include "TinyTool.h"
 #include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#endif
 //#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+void sq_skip_frame(struct string_queue_context* ctx);
+void sq_written(struct string_queue_context* ctx);
+
+/* Makes room for need bytes under the policy, 0 if the entry is rejected */
+uint32_t sq_admit(struct string_queue_context* ctx, uint32_t need, uint32_t framed)
+{
+    if ((need > ctx->buffer_len) ||
+        ((ctx->policy != RING_BUFFER_OVERWRITE) && (ctx->buffer_len - (ctx->wpos - ctx->rpos) < need)))
+    {
+        ctx->stats.rejected++;
+        return 0;
+    }
+    while (ctx->buffer_len - (ctx->wpos - ctx->rpos) < need)
+    {
+        if (framed)
+        {
+            sq_skip_frame(ctx);
+        }
+        else
+        {
+            while (ctx->buffer[ctx->rpos % ctx->buffer_len] != '\0')
+            {
+                ctx->rpos++;
+            }
+            ctx->rpos++;
+        }
+        ctx->stats.dropped++;
+    }
+    return 1;
+}
+
+void string_queue_init(struct string_queue_context* ctx, char* buffer, uint32_t len)
+{
+    ctx->buffer = buffer;
+    ctx->buffer_len = len;
+    ctx->rpos = 0;
+    ctx->wpos = 0;
+    ctx->policy = RING_BUFFER_OVERWRITE;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+
 uint32_t string_queue_put(struct string_queue_context* ctx, const char* data)
 {
     uint32_t iter = 0;
     uint32_t write = 0;
+    if (!sq_admit(ctx, (uint32_t)strlen(data) + 1, 0))
+    {
+        return 0;
+    }
     while (1)
     {
         iter = ctx->wpos % ctx->buffer_len;
@@ -21,22 +71,19 @@ uint32_t string_queue_put(struct string_queue_context* ctx, const char* data)
             break;
         }
     }
-    if (ctx->wpos - ctx->rpos > ctx->buffer_len)
-    {
-        ctx->rpos = ctx->wpos - ctx->buffer_len;
-    }
     if (ctx->rpos > ctx->buffer_len * 10)
     {
         ctx->rpos -= ctx->buffer_len * 10;
         ctx->wpos -= ctx->buffer_len * 10;
     }
+    sq_written(ctx);
     return write;
 }
 uint32_t string_queue_get(struct string_queue_context* ctx, char* data, uint32_t len)
 {
     uint32_t iter = 0;
     uint32_t read = 0;
-    while (1)
+    while (len > 0)
     {
         if (ctx->rpos >= ctx->wpos)
         {
@@ -44,12 +91,16 @@ uint32_t string_queue_get(struct string_queue_context* ctx, char* data, uint32_t
         }
 
         iter = ctx->rpos % ctx->buffer_len;
-        ((unsigned char*)data)[read] = ctx->buffer[iter];
+        if (read < len)
+        {
+            ((unsigned char*)data)[read] = (read + 1 < len) ? ctx->buffer[iter] : '\0';
+            read++;
+        }
         ctx->rpos++;
-        read++;
 
         if (ctx->buffer[iter] == '\0')
         {
+            ctx->stats.total_out++;
             break;
         }
     }
@@ -57,6 +108,131 @@ uint32_t string_queue_get(struct string_queue_context* ctx, char* data, uint32_t
 }
 
 
+/* Framed positions stay below 2 * buffer_len, so one compare replaces the modulo */
+uint32_t sq_offset(struct string_queue_context* ctx, uint32_t pos)
+{
+    return (pos >= ctx->buffer_len) ? pos - ctx->buffer_len : pos;
+}
+void sq_copy_in(struct string_queue_context* ctx, uint32_t pos, const void* src, uint32_t len)
+{
+    uint32_t offset = sq_offset(ctx, pos);
+    uint32_t first = ctx->buffer_len - offset;
+    if (first > len) { first = len; }
+    memcpy(ctx->buffer + offset, src, first);
+    memcpy(ctx->buffer, (const char*)src + first, len - first);
+}
+void sq_copy_out(struct string_queue_context* ctx, uint32_t pos, void* dst, uint32_t len)
+{
+    uint32_t offset = sq_offset(ctx, pos);
+    uint32_t first = ctx->buffer_len - offset;
+    if (first > len) { first = len; }
+    memcpy(dst, ctx->buffer + offset, first);
+    memcpy((char*)dst + first, ctx->buffer, len - first);
+}
+void sq_consume(struct string_queue_context* ctx, uint32_t len)
+{
+    ctx->rpos += len;
+    if (ctx->rpos >= ctx->buffer_len)
+    {
+        ctx->rpos -= ctx->buffer_len;
+        ctx->wpos -= ctx->buffer_len;
+    }
+}
+void sq_skip_frame(struct string_queue_context* ctx)
+{
+    uint32_t len = 0;
+    sq_copy_out(ctx, ctx->rpos, &len, STRING_QUEUE_FRAME_HEADER);
+    sq_consume(ctx, STRING_QUEUE_FRAME_HEADER + len);
+}
+void sq_written(struct string_queue_context* ctx)
+{
+    ctx->stats.total_in++;
+    if (ctx->wpos - ctx->rpos > ctx->stats.high_water)
+    {
+        ctx->stats.high_water = ctx->wpos - ctx->rpos;
+    }
+}
+
+uint32_t string_queue_put_frame(struct string_queue_context* ctx, const char* data)
+{
+    uint32_t len = (uint32_t)strlen(data);
+    if (!sq_admit(ctx, STRING_QUEUE_FRAME_HEADER + len, 1))
+    {
+        return 0;
+    }
+    sq_copy_in(ctx, ctx->wpos, &len, STRING_QUEUE_FRAME_HEADER);
+    sq_copy_in(ctx, ctx->wpos + STRING_QUEUE_FRAME_HEADER, data, len);
+    ctx->wpos += STRING_QUEUE_FRAME_HEADER + len;
+    sq_written(ctx);
+    return STRING_QUEUE_FRAME_HEADER + len;
+}
+
+int32_t string_queue_peek_frame(struct string_queue_context* ctx)
+{
+    uint32_t len = 0;
+    if (ctx->wpos == ctx->rpos)
+    {
+        return -1;
+    }
+    sq_copy_out(ctx, ctx->rpos, &len, STRING_QUEUE_FRAME_HEADER);
+    return (int32_t)len;
+}
+
+int32_t string_queue_get_frame(struct string_queue_context* ctx, char* data, uint32_t len)
+{
+    int32_t entry = string_queue_peek_frame(ctx);
+    uint32_t copy = 0;
+    if (entry < 0)
+    {
+        return -1;
+    }
+    if (len > 0)
+    {
+        copy = ((uint32_t)entry < len) ? (uint32_t)entry : len - 1;
+        sq_copy_out(ctx, ctx->rpos + STRING_QUEUE_FRAME_HEADER, data, copy);
+        data[copy] = '\0';
+    }
+    sq_consume(ctx, STRING_QUEUE_FRAME_HEADER + (uint32_t)entry);
+    ctx->stats.total_out++;
+    return entry;
+}
+
+uint32_t string_queue_put_batch(struct string_queue_context* ctx, const char* const* data, uint32_t count)
+{
+    uint32_t i = 0;
+    for ( ; i < count; ++i)
+    {
+        if (string_queue_put_frame(ctx, data[i]) == 0)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+uint32_t string_queue_get_batch(struct string_queue_context* ctx, char* data, uint32_t len, char** strings, uint32_t count)
+{
+    uint32_t i = 0;
+    uint32_t used = 0;
+    int32_t entry = 0;
+    for ( ; i < count; ++i)
+    {
+        entry = string_queue_peek_frame(ctx);
+        if (entry < 0 || len - used <= (uint32_t)entry)
+        {
+            break;
+        }
+        sq_copy_out(ctx, ctx->rpos + STRING_QUEUE_FRAME_HEADER, data + used, (uint32_t)entry);
+        data[used + (uint32_t)entry] = '\0';
+        strings[i] = data + used;
+        used += (uint32_t)entry + 1;
+        sq_consume(ctx, STRING_QUEUE_FRAME_HEADER + (uint32_t)entry);
+        ctx->stats.total_out++;
+    }
+    return i;
+}
+
+
 int32_t move_compare(const char* str, uint32_t* offset, uint32_t length, const char* compare)
 {
     int32_t result = 1;
@@ -149,6 +325,171 @@ int32_t string_to_index(const char* str)
 }
 
 
+/* Acquire / release access for the string index, slots are published after their payload */
+#if defined(__GNUC__) || defined(__clang__)
+#define si_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define si_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define si_try_lock(p) (__atomic_exchange_n((p), 1u, __ATOMIC_ACQUIRE) == 0)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+static __inline uint32_t si_load(const uint32_t* p) { uint32_t v = *(const volatile uint32_t*)p; _ReadWriteBarrier(); return v; }
+static __inline void si_store(uint32_t* p, uint32_t v) { _ReadWriteBarrier(); *(volatile uint32_t*)p = v; }
+#define si_try_lock(p) (_InterlockedExchange((volatile long*)(p), 1) == 0)
+#elif defined(_MSC_VER)
+#define si_load(p) ((uint32_t)_InterlockedOr((volatile long*)(p), 0))
+#define si_store(p, v) ((void)_InterlockedExchange((volatile long*)(p), (long)(v)))
+#define si_try_lock(p) (_InterlockedExchange((volatile long*)(p), 1) == 0)
+#else
+#define si_load(p) (*(p))
+#define si_store(p, v) (*(p) = (v))
+#define si_try_lock(p) ((*(p) = 1) != 0)
+#endif
+#define si_unlock(p) si_store((p), 0u)
+
+void si_relax(void)
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__unix__) || defined(__APPLE__)
+    sched_yield();
+#endif
+}
+
+uint32_t si_hash(const char* str, uint32_t* len)
+{
+    uint32_t hash = 2166136261u;
+    const unsigned char* iter = (const unsigned char*)str;
+    while (*iter)
+    {
+        hash = (hash ^ *iter++) * 16777619u;
+    }
+    *len = (uint32_t)(iter - (const unsigned char*)str);
+    return hash;
+}
+uint32_t si_probe(const struct string_index_context* ctx, const char* str, uint32_t hash, uint32_t* index)
+{
+    uint32_t pos = hash & ctx->slot_mask;
+    struct string_index_slot* slot = NULL;
+    while (1)
+    {
+        slot = &ctx->slots[pos];
+        *index = si_load(&slot->index);
+        if (*index == 0)
+        {
+            break;
+        }
+        if (slot->hash == hash && strcmp(ctx->arena + ctx->offsets[*index - 1], str) == 0)
+        {
+            break;
+        }
+        pos = (pos + 1) & ctx->slot_mask;
+    }
+    return pos;
+}
+
+int32_t string_index_init(struct string_index_context* ctx, void* buffer, uint32_t buffer_len, uint32_t max_count)
+{
+    uintptr_t base = ((uintptr_t)buffer + 3) & ~(uintptr_t)3;
+    uint32_t skip = (uint32_t)(base - (uintptr_t)buffer);
+    /* 64-bit so that a huge max_count fails the size check instead of wrapping */
+    uint64_t slot_count = 2;
+    uint64_t table_len = 0;
+    while (slot_count < (uint64_t)max_count * 2)
+    {
+        slot_count <<= 1;
+    }
+    table_len = slot_count * sizeof(struct string_index_slot) + (uint64_t)max_count * sizeof(uint32_t);
+    if (buffer == NULL || max_count == 0 || buffer_len < skip || buffer_len - skip <= table_len)
+    {
+        memset(ctx, 0, sizeof(*ctx));
+        return -1;
+    }
+    ctx->slots = (struct string_index_slot*)base;
+    ctx->offsets = (uint32_t*)(ctx->slots + slot_count);
+    ctx->arena = (char*)(ctx->offsets + max_count);
+    ctx->slot_mask = (uint32_t)(slot_count - 1);
+    ctx->max_count = max_count;
+    ctx->arena_len = (uint32_t)(buffer_len - skip - table_len);
+    string_index_clear(ctx);
+    return 0;
+}
+
+void string_index_clear(struct string_index_context* ctx)
+{
+    if (ctx->slots)
+    {
+        memset(ctx->slots, 0, (ctx->slot_mask + 1) * sizeof(struct string_index_slot));
+    }
+    ctx->count = 0;
+    ctx->arena_used = 0;
+    ctx->lock = 0;
+}
+
+int32_t string_index_put(struct string_index_context* ctx, const char* str)
+{
+    uint32_t len = 0;
+    uint32_t hash = 0;
+    uint32_t pos = 0;
+    uint32_t index = 0;
+    int32_t result = -1;
+    if (str == NULL || ctx->slots == NULL)
+    {
+        return -1;
+    }
+    hash = si_hash(str, &len);
+    pos = si_probe(ctx, str, hash, &index);
+    if (index != 0)
+    {
+        return (int32_t)(index - 1);
+    }
+
+    while (!si_try_lock(&ctx->lock))
+    {
+        si_relax();
+    }
+    /* Another writer may have taken the slot or inserted this string meanwhile */
+    pos = si_probe(ctx, str, hash, &index);
+    if (index != 0)
+    {
+        result = (int32_t)(index - 1);
+    }
+    else if (ctx->count < ctx->max_count && ctx->arena_len - ctx->arena_used > len)
+    {
+        index = ctx->count;
+        memcpy(ctx->arena + ctx->arena_used, str, len + 1);
+        ctx->offsets[index] = ctx->arena_used;
+        ctx->arena_used += len + 1;
+        ctx->slots[pos].hash = hash;
+        /* count first, so an index seen in a slot is always valid for string_index_str */
+        si_store(&ctx->count, index + 1);
+        si_store(&ctx->slots[pos].index, index + 1);
+        result = (int32_t)index;
+    }
+    si_unlock(&ctx->lock);
+    return result;
+}
+
+int32_t string_index_find(const struct string_index_context* ctx, const char* str)
+{
+    uint32_t len = 0;
+    uint32_t index = 0;
+    if (str == NULL || ctx->slots == NULL)
+    {
+        return -1;
+    }
+    si_probe(ctx, str, si_hash(str, &len), &index);
+    return (int32_t)index - 1;
+}
+
+const char* string_index_str(const struct string_index_context* ctx, int32_t index)
+{
+    if (index < 0 || (uint32_t)index >= si_load(&ctx->count))
+    {
+        return NULL;
+    }
+    return ctx->arena + ctx->offsets[index];
+}
+
+
 #define rb_access(ctx, pos) ctx->m_data[(pos) % ctx->m_length]
 
 int8_t rb_readable(struct ring_buffer_ctx* ctx, uint32_t pos)
@@ -160,13 +501,51 @@ uint32_t rb_len(struct ring_buffer_ctx* ctx)
 {
     return ctx->m_wPos - ctx->m_rPos;
 }
+void rb_rebase(struct ring_buffer_ctx* ctx)
+{
+    /* Same as subtracting threshold until m_rPos <= threshold, a block may move it by several */
+    uint32_t shift = 0;
+    if ((ctx->threshold > 0) && (ctx->m_rPos > ctx->threshold))
+    {
+        shift = ((ctx->m_rPos - 1) / ctx->threshold) * ctx->threshold;
+        ctx->m_wPos -= shift;
+        ctx->m_rPos -= shift;
+    }
+}
+uint32_t rb_spans(struct ring_buffer_ctx* ctx, uint32_t pos, uint32_t len, struct ring_buffer_span span[2])
+{
+    uint32_t offset = pos % ctx->m_length;
+    uint32_t first = ctx->m_length - offset;
+    if (first > len) { first = len; }
+    span[0].data = ctx->m_data + offset;
+    span[0].len = first;
+    span[1].data = ctx->m_data;
+    span[1].len = len - first;
+    return len;
+}
 void rb_put(struct ring_buffer_ctx* ctx, uint8_t val)
 {
     rb_access(ctx, ctx->m_wPos++) = val;
     //printf("Put %d (%d) -> %d\n", ctx->m_wPos, ctx->m_wPos % ctx->m_length, ctx->m_data[ctx->m_wPos % ctx->m_length]);
     //ctx->m_wPos++;
     if (ctx->m_wPos - ctx->m_rPos > ctx->m_length) { ctx->m_rPos = ctx->m_wPos - ctx->m_length; }
-    if (ctx->m_rPos > ctx->threshold) { ctx->m_wPos -= ctx->threshold; ctx->m_rPos -= ctx->threshold; }
+    rb_rebase(ctx);
+}
+void rb_written(struct ring_buffer_ctx* ctx, uint32_t len)
+{
+    uint32_t used = rb_len(ctx);
+    if (used > ctx->m_length)
+    {
+        ctx->stats.dropped += used - ctx->m_length;
+        ctx->m_rPos = ctx->m_wPos - ctx->m_length;
+        used = ctx->m_length;
+    }
+    if (used > ctx->stats.high_water)
+    {
+        ctx->stats.high_water = used;
+    }
+    ctx->stats.total_in += len;
+    rb_rebase(ctx);
 }
 uint8_t rb_get(struct ring_buffer_ctx* ctx)
 {
@@ -186,6 +565,7 @@ void ring_buffer_clear(struct ring_buffer_ctx* ctx)
     ctx->m_wPos = 0;
     ctx->m_length = 0;
     ctx->threshold = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
 }
 
 uint32_t ring_buffer_len(struct ring_buffer_ctx* ctx)
@@ -193,30 +573,66 @@ uint32_t ring_buffer_len(struct ring_buffer_ctx* ctx)
     return rb_len(ctx);
 }
 
-void ring_buffer_put(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len)
+uint32_t ring_buffer_put(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len)
 {
-    uint32_t i = 0;
-    for ( ; i < len; ++i)
+    struct ring_buffer_span span[2];
+    uint32_t skip = 0;
+    uint32_t space = ctx->m_length - rb_len(ctx);
+    if ((ctx->policy != RING_BUFFER_OVERWRITE) && (len > space))
+    {
+        ctx->stats.rejected += len - space;
+        len = space;
+    }
+    if ((len == 0) || (ctx->m_length == 0))
+    {
+        return 0;
+    }
+    /* Only the last m_length bytes survive, earlier ones would be overwritten in this call */
+    if (len > ctx->m_length)
     {
-        rb_put(ctx, buffer[i]);
+        skip = len - ctx->m_length;
     }
+    rb_spans(ctx, ctx->m_wPos + skip, len - skip, span);
+    memcpy(span[0].data, buffer + skip, span[0].len);
+    memcpy(span[1].data, buffer + skip + span[0].len, span[1].len);
+    ctx->m_wPos += len;
+    rb_written(ctx, len);
+    return len;
 }
 
 uint32_t ring_buffer_get(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len)
 {
-    uint32_t i = 0;
-    for ( ; i < len; ++i)
+    len = ring_buffer_peek_block(ctx, 0, buffer, len);
+    ctx->m_rPos += len;
+    ctx->stats.total_out += len;
+    return len;
+}
+
+uint32_t ring_buffer_peek_block(struct ring_buffer_ctx* ctx, uint32_t offset, uint8_t* buffer, uint32_t len)
+{
+    struct ring_buffer_span span[2];
+    uint32_t available = rb_len(ctx);
+    if (offset >= available)
     {
-        if (rb_len(ctx) > 0)
-        {
-            buffer[i] = rb_get(ctx);
-        }
-        else
-        {
-            break;
-        }
+        return 0;
     }
-    return i;
+    available -= offset;
+    rb_spans(ctx, ctx->m_rPos + offset, (len < available) ? len : available, span);
+    memcpy(buffer, span[0].data, span[0].len);
+    memcpy(buffer + span[0].len, span[1].data, span[1].len);
+    return span[0].len + span[1].len;
+}
+
+uint32_t ring_buffer_skip(struct ring_buffer_ctx* ctx, uint32_t len)
+{
+    uint32_t available = rb_len(ctx);
+    if (len > available)
+    {
+        len = available;
+    }
+    ctx->m_rPos += len;
+    ctx->stats.total_out += len;
+    return len;
 }
 
 void ring_buffer_init(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len)
@@ -226,6 +642,35 @@ void ring_buffer_init(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len
     ctx->m_wPos = 0;
     ctx->m_length = len;
     ctx->threshold = len * 8;
+    ctx->policy = RING_BUFFER_OVERWRITE;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+
+uint32_t ring_buffer_reserve_write(struct ring_buffer_ctx* ctx, uint32_t len, struct ring_buffer_span span[2])
+{
+    uint32_t space = ctx->m_length - rb_len(ctx);
+    return rb_spans(ctx, ctx->m_wPos, (len < space) ? len : space, span);
+}
+
+void ring_buffer_commit_write(struct ring_buffer_ctx* ctx, uint32_t len)
+{
+    uint32_t space = ctx->m_length - rb_len(ctx);
+    len = (len < space) ? len : space;
+    ctx->m_wPos += len;
+    rb_written(ctx, len);
+}
+
+uint32_t ring_buffer_acquire_read(struct ring_buffer_ctx* ctx, struct ring_buffer_span span[2])
+{
+    return rb_spans(ctx, ctx->m_rPos, rb_len(ctx), span);
+}
+
+void ring_buffer_release_read(struct ring_buffer_ctx* ctx, uint32_t len)
+{
+    uint32_t available = rb_len(ctx);
+    len = (len < available) ? len : available;
+    ctx->m_rPos += len;
+    ctx->stats.total_out += len;
 }
 
 #ifdef __cplusplus
@@ -13,8 +13,36 @@ extern "C" {
 #endif
 
 
+/*---------------------------------------------------------*/
+/*  Ring Policy - What a put does when the ring is full    */
+/*   - OVERWRITE drops the oldest data, the default        */
+/*   - REJECT refuses what does not fit                    */
+/*   - Nothing can drain a C ring while a put waits, so    */
+/*     there is no blocking policy here; the C++ SPSC and  */
+/*     MPMC rings offer one                                */
+/*  Ring Stats - Counters to size rings from real traffic  */
+/*---------------------------------------------------------*/
+
+enum ring_buffer_policy
+{
+    RING_BUFFER_OVERWRITE = 0,
+    RING_BUFFER_REJECT = 1
+};
+
+struct ring_buffer_stats
+{
+    uint32_t dropped;       /* lost to OVERWRITE */
+    uint32_t rejected;      /* refused by REJECT or too large to ever fit */
+    uint32_t high_water;    /* largest fill level seen */
+    uint32_t total_in;
+    uint32_t total_out;
+};
+
+
 /*----------------------------------------------------------*/
 /*      String Queue - A string queue with ring buffer      */
+/*   - OVERWRITE drops whole oldest strings to make room    */
+/*   - Counters are in strings, high_water is in bytes      */
 /*----------------------------------------------------------*/
 
 struct string_queue_context
@@ -23,11 +51,39 @@ struct string_queue_context
     uint32_t buffer_len;
     uint32_t rpos;
     uint32_t wpos;
+    uint32_t policy;                    /* enum ring_buffer_policy */
+    struct ring_buffer_stats stats;
 };
 
+#define STRING_QUEUE_STATIC_INIT(buffer) { buffer, sizeof(buffer), 0, 0, RING_BUFFER_OVERWRITE, { 0, 0, 0, 0, 0 } }
+
+void string_queue_init(struct string_queue_context* ctx, char* buffer, uint32_t len);
+/* Returns the bytes stored, 0 if the string was rejected */
 uint32_t string_queue_put(struct string_queue_context* ctx, const char* data);
+/* Copies at most len bytes, a longer string is cut and still NUL terminated */
 uint32_t string_queue_get(struct string_queue_context* ctx, char* data, uint32_t len);
 
+/*---------------------------------------------------------*/
+/*  Framed String Queue - Length prefixed entries          */
+/*   - Each entry is a 4 byte length and the string, no    */
+/*     NUL, copied with at most two memcpy per part        */
+/*   - put returns 0 for an entry that is rejected         */
+/*   - get_frame works like snprintf: returns the entry    */
+/*     length, >= len means it was truncated; -1 if empty  */
+/*   - get_batch packs whole entries into data and points  */
+/*     strings[] at them. An entry longer than the space   */
+/*     left stays queued, use peek_frame to size a buffer  */
+/*   - Use one queue either framed or with put/get above   */
+/*---------------------------------------------------------*/
+
+#define STRING_QUEUE_FRAME_HEADER 4
+
+uint32_t string_queue_put_frame(struct string_queue_context* ctx, const char* data);
+int32_t string_queue_get_frame(struct string_queue_context* ctx, char* data, uint32_t len);
+int32_t string_queue_peek_frame(struct string_queue_context* ctx);
+uint32_t string_queue_put_batch(struct string_queue_context* ctx, const char* const* data, uint32_t count);
+uint32_t string_queue_get_batch(struct string_queue_context* ctx, char* data, uint32_t len, char** strings, uint32_t count);
+
 
 /*---------------------------------------------------------*/
 /*  String to Index - Cache and Mapping a String to Index  */
@@ -40,6 +96,48 @@ uint32_t string_queue_get(struct string_queue_context* ctx, char* data, uint32_t
 #define STRING_INDEX_BUFFER_LEN 64
 int32_t string_to_index(const char* str);
 
+/*---------------------------------------------------------*/
+/*  String Index - Hash based string interning             */
+/*   - All storage is carved from one caller buffer, no    */
+/*     malloc, so a static array works on MCU builds       */
+/*   - Open addressing with FNV-1a, O(1) average lookup    */
+/*   - Indices are dense from 0 and stable until clear     */
+/*   - string_index_str maps an index back to the string   */
+/*   - put returns -1 when the table or arena is full      */
+/*   - find, str and put of an interned string are lock    */
+/*     free, inserts are serialized by a spinlock; init    */
+/*     and clear must not race with other calls. Without   */
+/*     GCC, Clang or MSVC atomics it is single threaded    */
+/*---------------------------------------------------------*/
+
+struct string_index_slot
+{
+    uint32_t hash;
+    uint32_t index;     /* index + 1, 0 marks an empty slot */
+};
+
+struct string_index_context
+{
+    struct string_index_slot* slots;
+    uint32_t* offsets;
+    char* arena;
+    uint32_t slot_mask;
+    uint32_t max_count;
+    uint32_t arena_len;
+    uint32_t count;
+    uint32_t arena_used;
+    uint32_t lock;
+};
+
+/* Upper bound of the buffer bytes for max_count strings with arena_len bytes of text (terminators included) */
+#define STRING_INDEX_CONTEXT_SIZE(max_count, arena_len) ((max_count) * 36 + (arena_len) + 8)
+
+int32_t string_index_init(struct string_index_context* ctx, void* buffer, uint32_t buffer_len, uint32_t max_count);
+void string_index_clear(struct string_index_context* ctx);
+int32_t string_index_put(struct string_index_context* ctx, const char* str);
+int32_t string_index_find(const struct string_index_context* ctx, const char* str);
+const char* string_index_str(const struct string_index_context* ctx, int32_t index);
+
 
 /*---------------------------------------------------------*/
 /*  Ring Buffer of C version                               */
@@ -52,15 +150,42 @@ struct ring_buffer_ctx
     uint32_t m_wPos;
     uint32_t m_length;
     uint32_t threshold;
+    uint32_t policy;                    /* enum ring_buffer_policy */
+    struct ring_buffer_stats stats;     /* in bytes */
 };
 
-#define RING_BUFFER_STATIC_INIT(buffer) { buffer, 0, 0, sizeof(buffer), sizeof(buffer) * 8 }
+#define RING_BUFFER_STATIC_INIT(buffer) { buffer, 0, 0, sizeof(buffer), sizeof(buffer) * 8, RING_BUFFER_OVERWRITE, { 0, 0, 0, 0, 0 } }
 
 void ring_buffer_clear(struct ring_buffer_ctx* ctx);
 uint32_t ring_buffer_len(struct ring_buffer_ctx* ctx);
-void ring_buffer_put(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len);
+/* Returns the bytes taken from buffer, less than len only under REJECT */
+uint32_t ring_buffer_put(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len);
 uint32_t ring_buffer_get(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len);
 void ring_buffer_init(struct ring_buffer_ctx* ctx, uint8_t* buffer, uint32_t len);
+/* Copies up to len bytes starting offset bytes after the read position, nothing is consumed */
+uint32_t ring_buffer_peek_block(struct ring_buffer_ctx* ctx, uint32_t offset, uint8_t* buffer, uint32_t len);
+/* Drops up to len readable bytes, returns how many were dropped */
+uint32_t ring_buffer_skip(struct ring_buffer_ctx* ctx, uint32_t len);
+
+/*---------------------------------------------------------*/
+/*  Zero-copy access. A region is split in two at the end  */
+/*  of the buffer, so up to two spans are returned.        */
+/*   - reserve_write only reserves free space, fill it and */
+/*     publish it with commit_write                        */
+/*   - acquire_read returns all readable data, free the    */
+/*     consumed part with release_read                     */
+/*---------------------------------------------------------*/
+
+struct ring_buffer_span
+{
+    uint8_t* data;
+    uint32_t len;
+};
+
+uint32_t ring_buffer_reserve_write(struct ring_buffer_ctx* ctx, uint32_t len, struct ring_buffer_span span[2]);
+void ring_buffer_commit_write(struct ring_buffer_ctx* ctx, uint32_t len);
+uint32_t ring_buffer_acquire_read(struct ring_buffer_ctx* ctx, struct ring_buffer_span span[2]);
+void ring_buffer_release_read(struct ring_buffer_ctx* ctx, uint32_t len);
 
 #ifdef __cplusplus
 }
@@ -1,10 +1,32 @@
+// The tests cover TinyThreadPool, the parallel BitField ops and the timed ring put/get.
+#define TINY_THREADS
+
 #include "TinyFamily.h"
+#include "TinyMapping.h"
 #include "TinyTool.h"
 #include <limits>
+#include <algorithm>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <string>
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define TINY_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TINY_HAS_RDTSC
+#endif
 
 void Test_StringToIndex()
 {
@@ -39,6 +61,248 @@ void Test_StringToIndex()
     assert(index == 4);
 }
 
+void Test_StringIndex()
+{
+    static uint8_t buffer[STRING_INDEX_CONTEXT_SIZE(64, 1024)];
+    struct string_index_context ctx;
+    int32_t index = string_index_init(&ctx, buffer, 16, 64);
+    assert(index == -1);
+    index = string_index_init(&ctx, buffer, sizeof(buffer), 0x80000000u);
+    assert(index == -1);
+    index = string_index_init(&ctx, buffer, sizeof(buffer), 0x20000000u);
+    assert(index == -1);
+    index = string_index_put(&ctx, "in");
+    assert(index == -1);
+    index = string_index_init(&ctx, buffer, sizeof(buffer), 64);
+    assert(index == 0);
+
+    assert(string_index_find(&ctx, "index_xxx_01") == -1);
+    index = string_index_put(&ctx, "index_xxx_01");
+    assert(index == 0);
+    index = string_index_put(&ctx, "index_xxxx_02");
+    assert(index == 1);
+    index = string_index_put(&ctx, "");
+    assert(index == 2);
+    index = string_index_put(&ctx, "index_xxx_01");
+    assert(index == 0);
+    assert(string_index_find(&ctx, "index_xxxx_02") == 1);
+    assert(string_index_find(&ctx, "index_xxxx_0") == -1);
+    assert(strcmp(string_index_str(&ctx, 1), "index_xxxx_02") == 0);
+    assert(strcmp(string_index_str(&ctx, 2), "") == 0);
+    assert(string_index_str(&ctx, 3) == NULL);
+    assert(string_index_str(&ctx, -1) == NULL);
+    index = string_index_put(&ctx, NULL);
+    assert(index == -1);
+
+    char name[32];
+    string_index_clear(&ctx);
+    for (int32_t i = 0; i < 64; ++i)
+    {
+        sprintf(name, "metric.%d", i);
+        index = string_index_put(&ctx, name);
+        assert(index == i);
+    }
+    index = string_index_put(&ctx, "metric.64");
+    assert(index == -1);
+    for (int32_t i = 63; i >= 0; --i)
+    {
+        sprintf(name, "metric.%d", i);
+        assert(string_index_find(&ctx, name) == i);
+        index = string_index_put(&ctx, name);
+        assert(index == i);
+        assert(strcmp(string_index_str(&ctx, i), name) == 0);
+    }
+
+    // Arena exhaustion reports -1 and leaves the table intact
+    // 8 names take 16 slots and 8 offsets, 160 bytes, leaving a 16 byte arena
+    static uint32_t small[(4 + 160 + 16) / 4];
+    index = string_index_init(&ctx, (char*)small + 1, sizeof(small) - 1, 8);
+    assert(index == 0);
+    assert(ctx.arena_len == 16);
+    index = string_index_put(&ctx, "0123456789");
+    assert(index == 0);
+    index = string_index_put(&ctx, "0123456789ab");
+    assert(index == -1);
+    index = string_index_put(&ctx, "abc");
+    assert(index == 1);
+    assert(string_index_find(&ctx, "0123456789") == 0);
+}
+
+void Test_StringIndex_Threads()
+{
+    static const uint32_t names = 2000;
+    static const uint32_t threads = 8;
+    std::vector<uint8_t> buffer(STRING_INDEX_CONTEXT_SIZE(names, names * 16));
+    struct string_index_context ctx;
+    int32_t inited = string_index_init(&ctx, &buffer[0], (uint32_t)buffer.size(), names);
+    assert(inited == 0);
+
+    // Every thread interns all names in its own order, all must agree on the indices
+    std::vector< std::vector<int32_t> > seen(threads, std::vector<int32_t>(names, -1));
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&ctx, &seen, t]() {
+            char name[32];
+            for (uint32_t i = 0; i < names; ++i)
+            {
+                uint32_t n = (i * 7 + t * 131) % names;
+                sprintf(name, "tag.%u", n);
+                int32_t index = string_index_put(&ctx, name);
+                assert(index >= 0 && string_index_find(&ctx, name) == index);
+                assert(strcmp(string_index_str(&ctx, index), name) == 0);
+                seen[t][n] = index;
+            }
+        }));
+    }
+    for (uint32_t t = 0; t < threads; ++t)
+    {
+        workers[t].join();
+    }
+
+    assert(ctx.count == names);
+    std::vector<bool> used(names, false);
+    for (uint32_t n = 0; n < names; ++n)
+    {
+        for (uint32_t t = 1; t < threads; ++t)
+        {
+            assert(seen[t][n] == seen[0][n]);
+        }
+        assert(!used[seen[0][n]]);
+        used[seen[0][n]] = true;
+    }
+}
+
+static constexpr const char* METRIC_KEYS[] = { "cpu.load", "mem.used", "disk.read", "disk.write", "net.rx", "net.tx" };
+static constexpr TinyStringTable METRIC_TABLE(METRIC_KEYS);
+static_assert(METRIC_TABLE.unique(), "metric keys repeat");
+static_assert(METRIC_TABLE.size() == 6, "");
+static_assert(TINY_STRING_KEY(METRIC_TABLE, "cpu.load") == 0, "");
+static_assert(TINY_STRING_KEY(METRIC_TABLE, "net.tx") == 5, "");
+static_assert(METRIC_TABLE.index("disk") == -1, "");
+
+void Test_StringTable()
+{
+    static constexpr const char* REPEATED[] = { "a", "b", "a" };
+    static_assert(!TinyStringTable(REPEATED).unique(), "");
+
+    // Case labels only accept constants
+    int32_t index = TINY_STRING_KEY(METRIC_TABLE, "disk.write");
+    switch (index)
+    {
+    case TINY_STRING_KEY(METRIC_TABLE, "disk.read"): assert(false); break;
+    case TINY_STRING_KEY(METRIC_TABLE, "disk.write"): break;
+    default: assert(false); break;
+    }
+    assert(strcmp(METRIC_TABLE.str(2), "disk.read") == 0);
+    assert(METRIC_TABLE.str(6) == NULL);
+
+    TinyStringIndex names(METRIC_TABLE, 64, 1024);
+    assert(names.consistent());
+    assert(names.find("mem.used") == TINY_STRING_KEY(METRIC_TABLE, "mem.used"));
+    assert(names.index("net.rx") == TINY_STRING_KEY(METRIC_TABLE, "net.rx"));
+    assert(names.index("gpu.temp") == 6);
+    assert(names.index("cpu.load") == 0);
+    assert(strcmp(names.str(6), "gpu.temp") == 0);
+    assert(strcmp(names.str(TINY_STRING_KEY(METRIC_TABLE, "net.tx")), "net.tx") == 0);
+
+    TinyStringIndex tiny(METRIC_TABLE, 4, 1024);
+    assert(!tiny.consistent());
+
+    // C contexts get the same indices once the table is interned first
+    static uint8_t buffer[STRING_INDEX_CONTEXT_SIZE(16, 256)];
+    struct string_index_context ctx;
+    string_index_init(&ctx, buffer, sizeof(buffer), 16);
+    bool interned = METRIC_TABLE.intern(&ctx);
+    assert(interned);
+    assert(string_index_find(&ctx, "disk.write") == TINY_STRING_KEY(METRIC_TABLE, "disk.write"));
+}
+
+void Test_StringQueue()
+{
+    char buffer[64];
+    char data[64];
+    struct string_queue_context ctx = STRING_QUEUE_STATIC_INIT(buffer);
+
+    // Legacy get never writes past len
+    string_queue_put(&ctx, "hello world");
+    memset(data, 'x', sizeof(data));
+    uint32_t len = string_queue_get(&ctx, data, 6);
+    assert(len == 6 && strcmp(data, "hello") == 0 && data[6] == 'x');
+    len = string_queue_get(&ctx, data, sizeof(data));
+    assert(len == 0);
+    string_queue_put(&ctx, "abc");
+    len = string_queue_get(&ctx, data, 0);
+    assert(len == 0);
+    len = string_queue_get(&ctx, data, sizeof(data));
+    assert(len == 4 && strcmp(data, "abc") == 0);
+
+    // Framed entries across many wraps, a 64 byte ring holds 3 entries of 17 bytes
+    struct string_queue_context frame = STRING_QUEUE_STATIC_INIT(buffer);
+    frame.policy = RING_BUFFER_REJECT;
+    int32_t entry = string_queue_peek_frame(&frame);
+    assert(entry == -1);
+    entry = string_queue_get_frame(&frame, data, sizeof(data));
+    assert(entry == -1);
+    uint32_t put = 0, got = 0;
+    for (uint32_t round = 0; round < 1000; ++round)
+    {
+        char name[32];
+        while (1)
+        {
+            sprintf(name, "message %07u", put);
+            if (string_queue_put_frame(&frame, name) == 0) { break; }
+            ++put;
+        }
+        assert(put - got == 3);
+        uint32_t take = round % 3 + 1;
+        for (uint32_t i = 0; i < take; ++i, ++got)
+        {
+            sprintf(name, "message %07u", got);
+            entry = string_queue_peek_frame(&frame);
+            assert(entry == 15);
+            entry = string_queue_get_frame(&frame, data, sizeof(data));
+            assert(entry == 15 && strcmp(data, name) == 0);
+            assert(frame.rpos < frame.buffer_len && frame.wpos - frame.rpos <= frame.buffer_len);
+        }
+    }
+    while (string_queue_get_frame(&frame, data, sizeof(data)) >= 0) { }
+
+    // Oversized entries are rejected, short buffers truncate like snprintf
+    char big[80];
+    memset(big, 'b', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    len = string_queue_put_frame(&frame, big);
+    assert(len == 0);
+    len = string_queue_put_frame(&frame, "");
+    assert(len == STRING_QUEUE_FRAME_HEADER);
+    len = string_queue_put_frame(&frame, "truncated");
+    assert(len == STRING_QUEUE_FRAME_HEADER + 9);
+    entry = string_queue_get_frame(&frame, data, sizeof(data));
+    assert(entry == 0 && data[0] == '\0');
+    entry = string_queue_get_frame(&frame, data, 6);
+    assert(entry == 9 && strcmp(data, "trunc") == 0);
+    entry = string_queue_peek_frame(&frame);
+    assert(entry == -1);
+
+    // Batches stop at the first entry that does not fit
+    const char* in[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta-eta-eta" };
+    char* out[8];
+    uint32_t count = string_queue_put_batch(&frame, in, 7);
+    assert(count == 6);
+    count = string_queue_get_batch(&frame, data, 16, out, 8);
+    assert(count == 2 && strcmp(out[0], "alpha") == 0 && strcmp(out[1], "beta") == 0);
+    count = string_queue_get_batch(&frame, data, 3, out, 8);
+    assert(count == 0);
+    count = string_queue_get_batch(&frame, data, sizeof(data), out, 2);
+    assert(count == 2 && strcmp(out[0], "gamma") == 0 && strcmp(out[1], "delta") == 0);
+    count = string_queue_put_batch(&frame, in + 6, 1);
+    assert(count == 1);
+    count = string_queue_get_batch(&frame, data, sizeof(data), out, 8);
+    assert(count == 3);
+    assert(strcmp(out[0], "epsilon") == 0 && strcmp(out[1], "zeta") == 0 && strcmp(out[2], "eta-eta-eta") == 0);
+}
+
 void Test_TinySmooth()
 {
     {
@@ -175,6 +439,111 @@ void Test_TinySmooth()
         delete[] arr;
         arr = NULL;
     }
+
+    {
+        static const uint32_t loops = 200000;
+        static const uint32_t points = 500;
+
+        TinySmooth< int64_t, points > ts_int_x;
+        TinySmooth< double, points > ts_double_x;
+        TinyRingBuffer< int64_t, points > window;
+
+        for (uint32_t i = 0; i < loops; i++)
+        {
+            // Large offsets make a plain running sum of doubles drift.
+            int64_t val = (int64_t)(rand() % 2000001) - 1000000;
+            double offset = (i % 2 == 0) ? 1e12 : -1e12;
+            window.put(val);
+            ts_int_x.appendData(val);
+            ts_double_x.appendData(val + offset);
+
+            if (i % 997 == 0)
+            {
+                int64_t sum = 0;
+                double doubleSum = 0.0;
+                uint32_t count = window.length();
+                for (uint32_t j = 0; j < count; j++)
+                {
+                    sum += window.peek(j);
+                    doubleSum += window.peek(j) + (((i - count + 1 + j) % 2 == 0) ? 1e12 : -1e12);
+                }
+                assert(ts_int_x.smoothedData() == sum / count);
+                assert(fabs(ts_double_x.smoothedData() - doubleSum / count) < 1e-2);
+            }
+        }
+    }
+}
+
+template< uint32_t POINTS >
+void __statistics_check(uint32_t loops)
+{
+    TinyEma< double, POINTS > ema;
+    TinySlidingMin< int, POINTS > slidingMin;
+    TinySlidingMax< int, POINTS > slidingMax;
+    TinySlidingVariance< int, POINTS > slidingVariance;
+    TinySlidingMedian< int, POINTS > slidingMedian;
+    TinyRingBuffer< int, POINTS > window;
+
+    int sorted[POINTS];
+    double expectEma = 0.0;
+
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        // A narrow range gives plenty of duplicates.
+        int val = (rand() % 201) - 100;
+        window.put(val);
+        ema.appendData(val);
+        slidingMin.appendData(val);
+        slidingMax.appendData(val);
+        slidingVariance.appendData(val);
+        slidingMedian.appendData(val);
+
+        expectEma = (i == 0) ? val : expectEma + (2.0 / (POINTS + 1)) * (val - expectEma);
+        assert(fabs(ema.smoothedData() - expectEma) < 1e-9);
+
+        // The window never holds more than POINTS, the clamp lets the compiler see that sorted[] is large enough.
+        uint32_t count = std::min< uint32_t >((uint32_t)window.length(), POINTS);
+        int minVal = window.peek(0);
+        int maxVal = window.peek(0);
+        double sum = 0.0;
+        for (uint32_t j = 0; j < count; j++)
+        {
+            sorted[j] = window.peek(j);
+            minVal = std::min(minVal, sorted[j]);
+            maxVal = std::max(maxVal, sorted[j]);
+            sum += sorted[j];
+        }
+        assert(slidingMin.smoothedData() == minVal);
+        assert(slidingMax.smoothedData() == maxVal);
+
+        double mean = sum / count;
+        double m2 = 0.0;
+        for (uint32_t j = 0; j < count; j++)
+        {
+            m2 += (sorted[j] - mean) * (sorted[j] - mean);
+        }
+        assert(fabs(slidingVariance.mean() - mean) < 1e-6);
+        assert(fabs(slidingVariance.variance() - ((count > 1) ? m2 / (count - 1) : 0.0)) < 1e-6);
+
+        std::sort(sorted, sorted + count);
+        int median = sorted[count / 2];
+        if ((count >= 2) && (count % 2 == 0))
+        {
+            median = (median + sorted[(count - 1) / 2]) / 2;
+        }
+        assert(slidingMedian.smoothedData() == median);
+    }
+}
+
+void Test_TinyStatistics()
+{
+    srand((unsigned)time(NULL));
+
+    __statistics_check< 1 >(1000);
+    __statistics_check< 2 >(1000);
+    __statistics_check< 7 >(10000);
+    __statistics_check< 8 >(10000);
+    __statistics_check< 301 >(20000);
 }
 
 void Test_Ringbuffer()
@@ -240,6 +609,277 @@ void Test_Ringbuffer()
     delete[] compareBuffer; compareBuffer = NULL;
 }
 
+void Test_CircularBuffer_Block()
+{
+    static const uint32_t loops = 100000;
+    static const uint32_t bufferLen = 97;
+
+    uint8_t writeBuffer[bufferLen * 3];
+    uint8_t blockBuffer[bufferLen * 3];
+    uint8_t byteBuffer[bufferLen * 3];
+
+    // The same data goes through block write/read and the byte by byte put/get, results must be identical.
+    TinyCircularBuffer block(bufferLen);
+    TinyCircularBuffer byte(bufferLen);
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t loop = 0; loop < loops; ++loop)
+    {
+        uint32_t writeLen = (uint32_t)(rand() % (bufferLen * 3));
+        for (uint32_t i = 0; i < writeLen; ++i)
+        {
+            writeBuffer[i] = (uint8_t)rand();
+        }
+        uint32_t written = block.write(writeBuffer, writeLen);
+        assert(written == writeLen);
+        for (uint32_t i = 0; i < writeLen; ++i)
+        {
+            byte.put(writeBuffer[i]);
+        }
+        assert(block.length() == byte.length());
+
+        uint32_t offset = (uint32_t)(rand() % (bufferLen + 1));
+        uint32_t peekLen = (uint32_t)(rand() % (bufferLen * 3));
+        uint32_t peeked = block.peek(blockBuffer, peekLen, offset);
+        assert(peeked == ((offset < byte.length()) ? std::min<SIZETYPE>(peekLen, byte.length() - offset) : 0));
+        for (uint32_t i = 0; i < peeked; ++i)
+        {
+            assert(blockBuffer[i] == byte.peek(offset + i));
+        }
+
+        uint32_t readLen = (uint32_t)(rand() % (bufferLen * 3));
+        uint32_t readed = block.read(blockBuffer, readLen);
+        uint32_t byteReaded = 0;
+        for (; (byteReaded < readLen) && !byte.end(); ++byteReaded)
+        {
+            byteBuffer[byteReaded] = byte.get();
+        }
+        assert(readed == byteReaded);
+        assert(memcmp(blockBuffer, byteBuffer, readed) == 0);
+        assert(block.length() == byte.length());
+    }
+}
+
+void Test_CircularBuffer_Growable()
+{
+    uint8_t data[5000];
+    uint8_t out[5000];
+    for (uint32_t i = 0; i < sizeof(data); ++i) { data[i] = (uint8_t)(i * 7); }
+
+    // Growing keeps the order of data that wraps around the end of the old buffer
+    TinyGrowableCircularBuffer ring(16, 1000);
+    assert(ring.capacity() == 16 && ring.maxSize() == 1000);
+    SIZETYPE written = ring.write(data, 12);
+    SIZETYPE readed = ring.read(out, 10);
+    assert(written == 12 && readed == 10);
+    written = ring.write(data + 12, 10);
+    assert(written == 10 && ring.capacity() == 16);
+    written = ring.write(data + 22, 20);
+    assert(written == 20 && ring.capacity() == 32 && ring.length() == 32);
+    bool stored = ring.put(data[42]);
+    assert(stored && ring.capacity() == 64);
+    written = ring.write(data + 43, 300);
+    assert(written == 300 && ring.capacity() == 512 && ring.length() == 333);
+    readed = ring.read(out + 10, 333);
+    assert(readed == 333 && memcmp(data, out, 343) == 0);
+    assert(ring.stats().dropped == 0);
+
+    // At maxSize the policy applies again
+    written = ring.write(data, 1200);
+    assert(written == 1200 && ring.capacity() == 1000 && ring.length() == 1000);
+    assert(ring.stats().dropped == 200);
+    readed = ring.peek(out, 1000, 0);
+    assert(readed == 1000 && memcmp(out, data + 200, 1000) == 0);
+    ring.setPolicy(TINY_RING_REJECT);
+    written = ring.write(data, 10);
+    assert(written == 0);
+
+    // Sustained low occupancy halves it, never below the initial size and never losing data
+    readed = ring.read(out, 990);
+    assert(readed == 990);
+    for (uint32_t i = 0; i < TinyGrowableCircularBuffer::SHRINK_AFTER - 2; ++i)
+    {
+        assert(ring.capacity() == 1000);
+        ring.write(data + 2000 + i, 1);
+        ring.read(out, 1);
+    }
+    readed = ring.read(out, 1);
+    assert(readed == 1 && ring.capacity() == 500 && ring.length() == 9);
+    readed = ring.read(out, 6);
+    assert(readed == 6);
+    for (uint32_t i = 0; i < 10 * TinyGrowableCircularBuffer::SHRINK_AFTER; ++i)
+    {
+        ring.write(data + 3000 + i, 1);
+        ring.read(out, 1);
+    }
+    assert(ring.capacity() == 16 && ring.length() == 3);
+    readed = ring.read(out, 100);
+    assert(readed == 3 && memcmp(out, data + 3000 + 10 * TinyGrowableCircularBuffer::SHRINK_AFTER - 3, 3) == 0);
+
+    // A zero initial size starts at one byte, so there is something to double
+    TinyGrowableCircularBuffer tiny(0, 64);
+    assert(tiny.capacity() == 1 && tiny.maxSize() == 64);
+    written = tiny.write(data, 1);
+    assert(written == 1 && tiny.capacity() == 1);
+    written = tiny.write(data + 1, 10);
+    assert(written == 10 && tiny.capacity() == 16);
+    readed = tiny.read(out, 100);
+    assert(readed == 11 && memcmp(out, data, 11) == 0);
+    TinyGrowableCircularBuffer none(0, 0);
+    assert(none.capacity() == 1 && none.maxSize() == 1);
+}
+
+void Test_MirroredCircularBuffer()
+{
+#if defined(__linux__)
+    static const uint32_t loops = 20000;
+
+    // Without storage nothing is taken or returned
+    TinyMirroredCircularBuffer mirror;
+    assert(!mirror.created() && mirror.length() == 0);
+    uint8_t byte = 1;
+    bool putOk = mirror.put(byte);
+    uint8_t got = mirror.get();
+    SIZETYPE written = mirror.write(&byte, 1);
+    SIZETYPE readed = mirror.read(&byte, 1);
+    assert(!putOk && got == 0 && written == 0 && readed == 0 && mirror.length() == 0);
+
+    bool created = mirror.create(100);
+    assert(created);
+    SIZETYPE capacity = mirror.capacity();
+    assert((capacity >= 100) && (capacity % (SIZETYPE)sysconf(_SC_PAGESIZE) == 0));
+
+    // A region across the end of the buffer is still one range, the second copy shows the same bytes
+    std::vector< uint8_t > data(capacity * 4), out(capacity * 3), expect(capacity * 3);
+    for (uint32_t i = 0; i < data.size(); ++i) { data[i] = (uint8_t)(i * 13 + 5); }
+    written = mirror.write(data.data(), capacity - 10);
+    assert(written == capacity - 10);
+    readed = mirror.read(out.data(), capacity - 20);
+    assert(readed == capacity - 20);
+    written = mirror.write(data.data() + 7, 30);
+    assert(written == 30);
+    TinySpanPair< uint8_t > readable = mirror.acquireRead();
+    assert(readable.first.length == 40 && readable.second.length == 0);
+    assert(memcmp(readable.first.data, data.data() + capacity - 20, 10) == 0);
+    assert(memcmp(readable.first.data + 10, data.data() + 7, 30) == 0);
+    mirror.releaseRead(40);
+    TinySpanPair< uint8_t > writable = mirror.reserveWrite(capacity);
+    assert(writable.first.length == capacity && writable.second.length == 0);
+
+    // poke() reaches the unread bytes and the free space, nothing before or past them
+    written = mirror.write(data.data(), 3);
+    mirror.poke(-1, 0xAA);
+    mirror.poke(-4, 0xBB);
+    mirror.poke((int32_t)capacity - 3, 0xCC);
+    mirror.poke(INT32_MAX, 0xDD);
+    mirror.poke(INT32_MIN, 0xEE);
+    readed = mirror.read(out.data(), capacity);
+    assert(written == 3 && readed == 3 && out[0] == data[0] && out[1] == data[1] && out[2] == 0xAA);
+
+    // Same results and counters as the modulo ring under random traffic, including writes longer than the buffer
+    TinyMirroredCircularBuffer ring;
+    created = ring.create(capacity);
+    assert(created);
+    TinyCircularBuffer reference(capacity);
+    SIZETYPE expected = 0;
+    srand((unsigned)time(NULL));
+    for (uint32_t loop = 0; loop < loops; ++loop)
+    {
+        uint32_t len = (uint32_t)(rand() % (capacity * 5 / 2));
+        uint32_t from = (uint32_t)(rand() % capacity);
+        switch (rand() % 4)
+        {
+        case 0:
+            written = ring.write(data.data() + from, len);
+            expected = reference.write(data.data() + from, len);
+            assert(written == expected);
+            break;
+        case 1:
+            len %= 64;
+            for (uint32_t i = 0; i < len; ++i)
+            {
+                putOk = ring.put(data[from + i]);
+                bool referenceOk = reference.put(data[from + i]);
+                assert(putOk == referenceOk);
+            }
+            break;
+        case 2:
+            readed = ring.read(out.data(), len);
+            expected = reference.read(expect.data(), len);
+            assert(readed == expected);
+            assert(memcmp(out.data(), expect.data(), readed) == 0);
+            break;
+        default:
+            len %= 64;
+            for (uint32_t i = 0; i < len; ++i)
+            {
+                got = ring.get();
+                uint8_t referenceGot = reference.get();
+                assert(got == referenceGot);
+            }
+            break;
+        }
+        assert(ring.length() == reference.length());
+        readable = ring.acquireRead();
+        assert(readable.first.length == ring.length() && readable.second.length == 0);
+        SIZETYPE peeked = reference.peek(out.data(), capacity, 0);
+        assert((peeked == readable.first.length) && (memcmp(out.data(), readable.first.data, peeked) == 0));
+        if (loop % 1000 == 0) { ring.setPolicy((ring.policy() == TINY_RING_OVERWRITE) ? TINY_RING_REJECT : TINY_RING_OVERWRITE); reference.setPolicy(ring.policy()); }
+    }
+    assert(ring.stats().dropped == reference.stats().dropped && ring.stats().rejected == reference.stats().rejected);
+    assert(ring.stats().totalIn == reference.stats().totalIn && ring.stats().totalOut == reference.stats().totalOut);
+    assert(ring.stats().highWater == reference.stats().highWater);
+
+    ring.close();
+    assert(!ring.created() && ring.length() == 0);
+#endif
+}
+
+void Test_RingBuffer_Span()
+{
+    static const uint32_t loops = 100000;
+
+    TinyRingBuffer< uint32_t, 97 > ringbuffer;
+    uint32_t writeSeq = 0;
+    uint32_t readSeq = 0;
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t loop = 0; loop < loops; ++loop)
+    {
+        uint32_t space = ringbuffer.capacity() - ringbuffer.length();
+        uint32_t reserveLen = (uint32_t)(rand() % (ringbuffer.capacity() * 2));
+        TinySpanPair< uint32_t > writable = ringbuffer.reserveWrite(reserveLen);
+        assert(writable.length() == std::min(reserveLen, space));
+
+        uint32_t commitLen = writable.length() ? (uint32_t)(rand() % writable.length() + 1) : 0;
+        for (uint32_t i = 0; i < commitLen; ++i)
+        {
+            if (i < writable.first.length) { writable.first.data[i] = writeSeq++; }
+            else { writable.second.data[i - writable.first.length] = writeSeq++; }
+        }
+        ringbuffer.commitWrite(commitLen);
+        assert(ringbuffer.length() == writeSeq - readSeq);
+
+        TinySpanPair< uint32_t > readable = ringbuffer.acquireRead();
+        assert(readable.length() == writeSeq - readSeq);
+        uint32_t releaseLen = readable.length() ? (uint32_t)(rand() % readable.length() + 1) : 0;
+        for (uint32_t i = 0; i < releaseLen; ++i)
+        {
+            uint32_t val = (i < readable.first.length) ? readable.first.data[i] : readable.second.data[i - readable.first.length];
+            assert(val == readSeq);
+            ++readSeq;
+        }
+        ringbuffer.releaseRead(releaseLen);
+        assert(ringbuffer.length() == writeSeq - readSeq);
+    }
+}
+
+// The byte at a time primitives ring_buffer_put/get were built on, kept in TinyTool.c as the reference.
+extern "C" void rb_put(struct ring_buffer_ctx* ctx, uint8_t val);
+extern "C" uint8_t rb_get(struct ring_buffer_ctx* ctx);
+
 void Test_Ringbuffer_C()
 {
     uint32_t testDataLen = 10000000;
@@ -298,100 +938,872 @@ void Test_Ringbuffer_C()
         }
     }
 
+    // Block calls must leave the ring exactly as the original byte at a time rb_put/rb_get
+    uint8_t blockBuffer[99];
+    ring_buffer_ctx block_ctx;
+    ring_buffer_init(&rb_ctx, mainBuffer, testBufferLen);
+    ring_buffer_init(&block_ctx, blockBuffer, testBufferLen);
+    for (uint32_t round = 0; round < 200000; ++round)
+    {
+        uint32_t len = (uint32_t)(rand() % (testBufferLen * 5 / 2));
+        uint8_t* data = randomBuffer + rand() % (testDataLen - 256);
+        uint32_t op = (uint32_t)(rand() % 4);
+        if (op == 0)
+        {
+            for (uint32_t i = 0; i < len; ++i) { rb_put(&rb_ctx, data[i]); }
+            ring_buffer_put(&block_ctx, data, len);
+        }
+        else if (op == 1)
+        {
+            uint32_t got = 0;
+            while ((got < len) && (ring_buffer_len(&rb_ctx) > 0)) { compareBuffer[got++] = rb_get(&rb_ctx); }
+            uint32_t blockGot = ring_buffer_get(&block_ctx, compareBuffer + 256, len);
+            assert(blockGot == got);
+            assert(memcmp(compareBuffer, compareBuffer + 256, got) == 0);
+        }
+        else if (op == 2)
+        {
+            uint32_t offset = len / 4;
+            uint32_t peeked = ring_buffer_peek_block(&block_ctx, offset, compareBuffer + 256, len);
+            assert(peeked == std::min(len, ring_buffer_len(&rb_ctx) > offset ? ring_buffer_len(&rb_ctx) - offset : 0));
+            ring_buffer_span span[2];
+            ring_buffer_acquire_read(&rb_ctx, span);
+            for (uint32_t i = offset; i < offset + peeked; ++i)
+            {
+                assert(compareBuffer[256 + i - offset] == ((i < span[0].len) ? span[0].data[i] : span[1].data[i - span[0].len]));
+            }
+        }
+        else
+        {
+            uint32_t skipped = ring_buffer_skip(&block_ctx, len);
+            assert(skipped == std::min(len, ring_buffer_len(&rb_ctx)));
+            ring_buffer_release_read(&rb_ctx, skipped);
+        }
+        assert((rb_ctx.m_rPos == block_ctx.m_rPos) && (rb_ctx.m_wPos == block_ctx.m_wPos));
+    }
+    assert(memcmp(mainBuffer, blockBuffer, testBufferLen) == 0);
+
     delete[] mainBuffer; mainBuffer = NULL;
     delete[] randomBuffer; randomBuffer = NULL;
     delete[] compareBuffer; compareBuffer = NULL;
 }
 
-
-void __gen_pos_array(uint32_t* posArr, uint32_t count, uint32_t lower, uint32_t upper)
+void Test_SpscRingBuffer()
 {
-    for (uint32_t i = 0; i < count; ++i)
+    static const uint32_t loops = 10000000;
+
+    TinySpscRingBuffer< uint32_t, 1000 > spsc;
+    assert(spsc.end());
+    assert(spsc.capacity() == 1000);
+
+    for (uint32_t i = 0; i < spsc.capacity(); ++i)
     {
-        //uint32_t randomVal = (uint32_t)((rand() << 48) | (rand() << 32) | (rand() << 16) | rand());
-        //posArr[i] = (randomVal % (upper - lower)) + lower;
-        posArr[i] = rand();
+        bool stored = spsc.put(i);
+        assert(stored);
     }
-}
-
-#define BF_OP_SET 1
-#define BF_OP_CLR 2
-void __bit_field_op(TinyBitField& tbf, uint32_t* posArr, uint32_t count, uint8_t op)
-{
-    for (uint32_t i = 0; i < count; ++i)
+    assert(spsc.full());
+    bool overflowed = spsc.put(0);
+    assert(!overflowed);
+    assert(spsc.length() == 1000);
+    for (uint32_t i = 0; i < spsc.capacity(); ++i)
     {
-        if (op == BF_OP_SET)
+        uint32_t val = spsc.get();
+        assert(val == i);
+    }
+    assert(spsc.end());
+
+    // Bulk copies wrap around the end of the buffer and stop at full or empty.
+    uint32_t block[1500];
+    for (uint32_t i = 0; i < 1500; ++i) { block[i] = i; }
+    SIZETYPE first = spsc.write(block, 700);
+    SIZETYPE rest = spsc.write(block + 700, 800);
+    SIZETYPE none = spsc.write(block, 1);
+    assert(first == 700 && rest == 300 && none == 0);
+    uint32_t out[1500] = { 0 };
+    SIZETYPE head = spsc.read(out, 600);
+    SIZETYPE wrapped = spsc.write(block + 1000, 500);
+    SIZETYPE tail = spsc.read(out + 600, 1500);
+    SIZETYPE empty = spsc.read(out, 1);
+    assert(head == 600 && wrapped == 500 && tail == 900 && empty == 0);
+    for (uint32_t i = 0; i < 1500; ++i) { assert(out[i] == i); }
+    assert(spsc.end());
+
+    std::thread producer([&spsc]()
+    {
+        for (uint32_t i = 0; i < loops; )
         {
-            tbf.bitSet(posArr[i]);
+            if (spsc.put(i)) { ++i; } else { std::this_thread::yield(); }
         }
-        else if (op == BF_OP_CLR)
+    });
+
+    uint32_t val = 0;
+    for (uint32_t i = 0; i < loops; )
+    {
+        if (spsc.get(val))
         {
-            tbf.bitClr(posArr[i]);
+            assert(val == i);
+            ++i;
         }
         else
         {
-            assert(false);
+            std::this_thread::yield();
         }
     }
+    producer.join();
+    assert(spsc.end());
 }
 
-#define BF_CHK_SET 3
-#define BF_CHK_CLR 4
-void __bit_field_check(TinyBitField& tbf, uint32_t* posArr, uint32_t count, uint8_t op)
+void Test_MpmcRingBuffer()
 {
-    for (uint32_t i = 0; i < count; ++i)
+    TinyMpmcRingBuffer< uint32_t, 100 > reject;
+    assert(reject.end() && reject.capacity() == 100);
+    for (uint32_t i = 0; i < 100; ++i) { bool stored = reject.put(i); assert(stored); }
+    bool stored = reject.put(100);
+    bool waited = reject.put(100, 1);
+    assert(!stored && !waited);
+    assert(reject.length() == 100);
+    uint32_t val = 0;
+    for (uint32_t i = 0; i < 100; ++i) { bool got = reject.get(val); assert(got && val == i); }
+    bool got = reject.get(val);
+    waited = reject.get(val, 1);
+    assert(!got && !waited);
+
+    TinyMpmcRingBuffer< uint32_t, 64, TINY_RING_OVERWRITE > overwrite;
+    for (uint32_t i = 0; i < 1000; ++i) { stored = overwrite.put(i); assert(stored); }
+    assert(overwrite.length() == 64);
+    for (uint32_t i = 1000 - 64; i < 1000; ++i) { val = overwrite.get(); assert(val == i); }
+    assert(overwrite.end());
+
+    // Every value arrives exactly once, and in order per producer for each consumer
+    static const uint32_t producers = 4;
+    static const uint32_t consumers = 4;
+    static const uint32_t loops = 200000;
+    TinyMpmcRingBuffer< uint64_t, 256 > queue;
+    std::atomic< uint64_t > sum(0);
+    std::atomic< uint32_t > received(0);
+    std::vector< std::thread > threads;
+    for (uint32_t p = 0; p < producers; ++p)
     {
-        if (op == BF_CHK_SET)
+        threads.push_back(std::thread([&queue, p]()
         {
-            assert(tbf.bitCheck(posArr[i]));
-        }
-        else if (op == BF_CHK_CLR)
+            for (uint32_t i = 0; i < loops; ++i) { queue.put(((uint64_t)p << 32) | i, -1); }
+        }));
+    }
+    for (uint32_t c = 0; c < consumers; ++c)
+    {
+        threads.push_back(std::thread([&queue, &sum, &received]()
         {
-            assert(!tbf.bitCheck(posArr[i]));
-        }
+            int64_t last[producers] = { -1, -1, -1, -1 };
+            uint64_t local = 0, item = 0;
+            while (received.load() < producers * loops)
+            {
+                if (!queue.get(item, 10)) { continue; }
+                uint32_t p = (uint32_t)(item >> 32);
+                assert((int64_t)(uint32_t)item > last[p]);
+                last[p] = (uint32_t)item;
+                local += (uint32_t)item;
+                received.fetch_add(1);
+            }
+            sum.fetch_add(local);
+        }));
     }
-}
-#define BF_CHK_OR 15
-#define BF_CHK_AND 16
-#define BF_CHK_XOR 17
-void __bit_field_check(TinyBitField& tbf, uint32_t* posArr1, uint32_t* posArr2, uint32_t count, uint8_t op)
-{
+    for (uint32_t i = 0; i < threads.size(); ++i) { threads[i].join(); }
+    assert(received.load() == producers * loops);
+    assert(sum.load() == (uint64_t)producers * loops * (loops - 1) / 2);
+    assert(queue.end());
+
+    // Under OVERWRITE with contention producers never wait, nothing arrives twice and order per producer holds
+    TinyMpmcRingBuffer< uint64_t, 16, TINY_RING_OVERWRITE > lossy;
+    std::vector< std::atomic< uint8_t > > seen(producers * loops);
+    for (uint32_t i = 0; i < seen.size(); ++i) { seen[i].store(0); }
+    std::atomic< uint32_t > done(0);
+    received.store(0);
+    threads.clear();
+    for (uint32_t p = 0; p < producers; ++p)
+    {
+        threads.push_back(std::thread([&lossy, &done, p]()
+        {
+            for (uint32_t i = 0; i < loops; ++i) { lossy.put(((uint64_t)p << 32) | i); }
+            done.fetch_add(1);
+        }));
+    }
+    for (uint32_t c = 0; c < consumers; ++c)
+    {
+        threads.push_back(std::thread([&lossy, &done, &seen, &received]()
+        {
+            int64_t last[producers] = { -1, -1, -1, -1 };
+            uint64_t item = 0;
+            while ((done.load() < producers) || !lossy.end())
+            {
+                if (!lossy.get(item)) { std::this_thread::yield(); continue; }
+                uint32_t p = (uint32_t)(item >> 32);
+                assert((int64_t)(uint32_t)item > last[p]);
+                last[p] = (uint32_t)item;
+                uint8_t before = seen[p * loops + (uint32_t)item].fetch_add(1);
+                assert(before == 0);
+                received.fetch_add(1);
+            }
+        }));
+    }
+    for (uint32_t i = 0; i < threads.size(); ++i) { threads[i].join(); }
+    assert(received.load() > 0 && received.load() <= producers * loops);
+    assert(lossy.end());
 }
 
-void Test_BitField_SetClr()
+void Test_RingPolicy()
 {
-    const uint32_t TEST_BIT_COUT = 1000000;
-    const uint32_t TOTAL_BIT_COUT = 100000000;
-
-    BitField tbf1(TOTAL_BIT_COUT);
-    BitField tbf2(TOTAL_BIT_COUT);
-    uint32_t* setPos = new uint32_t[TEST_BIT_COUT];
-    uint32_t* clrPos = new uint32_t[TEST_BIT_COUT];
-
-    assert(tbf1.allZero());
-    assert(tbf2.allZero());
+    // Shell: OVERWRITE counts what it drops, REJECT what it refuses
+    {
+        TinyRingBuffer< uint32_t, 10 > ring;
+        for (uint32_t i = 0; i < 25; ++i) { bool stored = ring.put(i); assert(stored); }
+        for (uint32_t i = 0; i < 4; ++i) { uint32_t val = ring.get(); assert(val == 15 + i); }
+        assert(ring.stats().dropped == 15 && ring.stats().rejected == 0);
+        assert(ring.stats().highWater == 10 && ring.stats().totalIn == 25 && ring.stats().totalOut == 4);
+
+        ring.setPolicy(TINY_RING_REJECT);
+        ring.resetStats();
+        for (uint32_t i = 0; i < 4; ++i) { bool stored = ring.put(100 + i); assert(stored); }
+        bool first = ring.put(200);
+        bool second = ring.put(201);
+        uint32_t val = ring.get();
+        assert(!first && !second && val == 19);
+        assert(ring.stats().rejected == 2 && ring.stats().dropped == 0 && ring.stats().totalIn == 4);
+    }
+    {
+        TinyCircularBuffer ring(100);
+        uint8_t data[250] = { 0 };
+        SIZETYPE written = ring.write(data, 250);
+        assert(written == 250);
+        assert(ring.stats().dropped == 150 && ring.stats().highWater == 100);
+        ring.setPolicy(TINY_RING_REJECT);
+        SIZETYPE readed = ring.read(data, 30);
+        written = ring.write(data, 50);
+        assert(readed == 30 && written == 30);
+        assert(ring.stats().rejected == 20 && ring.stats().totalIn == 280 && ring.stats().totalOut == 30);
+    }
 
-    srand((unsigned)time(NULL));
+    // SPSC rejects or waits, MPMC can block
+    {
+        TinySpscRingBuffer< uint32_t, 8 > spsc;
+        for (uint32_t i = 0; i < 8; ++i) { bool stored = spsc.put(i); assert(stored); }
+        bool stored = spsc.put(8);
+        bool waited = spsc.put(8, 1);
+        assert(!stored && !waited);
+        std::thread consumer([&spsc]() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); uint32_t head = spsc.get(); assert(head == 0); });
+        waited = spsc.put(8, -1);
+        consumer.join();
+        assert(waited);
+        uint32_t val = 0;
+        for (uint32_t i = 1; i <= 8; ++i) { bool got = spsc.get(val, 0); assert(got && val == i); }
+        waited = spsc.get(val, 1);
+        assert(!waited);
+        TinyRingStats stats = spsc.stats();
+        assert(stats.rejected == 2 && stats.totalIn == 9 && stats.totalOut == 9 && stats.highWater == 8);
+
+        // A bulk write counts what it cuts off, like a failed put per element.
+        uint32_t block[12] = { 0 };
+        SIZETYPE written = spsc.write(block, 12);
+        SIZETYPE more = spsc.write(block, 1);
+        stats = spsc.stats();
+        assert(written == 8 && more == 0 && stats.rejected == 2 + 4 + 1 && stats.totalIn == 17);
+    }
+    {
+        TinyMpmcRingBuffer< uint32_t, 4, TINY_RING_BLOCK > mpmc;
+        for (uint32_t i = 0; i < 4; ++i) { bool stored = mpmc.put(i); assert(stored); }
+        bool waited = mpmc.put(4, 1);
+        assert(!waited);
+        std::thread consumer([&mpmc]() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); uint32_t head = mpmc.get(); assert(head == 0); });
+        waited = mpmc.put(4);
+        consumer.join();
+        assert(waited);
+        for (uint32_t i = 1; i <= 4; ++i) { uint32_t val = mpmc.get(); assert(val == i); }
+    }
 
-    __gen_pos_array(setPos, TEST_BIT_COUT, 0, TOTAL_BIT_COUT);
-    __bit_field_op(tbf1, setPos, TEST_BIT_COUT, BF_OP_SET);
-    __bit_field_check(tbf1, setPos, TEST_BIT_COUT, BF_CHK_SET);
+    // C ring counts bytes
+    {
+        uint8_t buffer[16];
+        uint8_t data[40] = { 0 };
+        ring_buffer_ctx ctx = RING_BUFFER_STATIC_INIT(buffer);
+        assert(ctx.policy == RING_BUFFER_OVERWRITE && ctx.stats.total_in == 0);
+        uint32_t len = ring_buffer_put(&ctx, data, 40);
+        assert(len == 40);
+        len = ring_buffer_get(&ctx, data, 6);
+        assert(len == 6);
+        assert(ctx.stats.dropped == 24 && ctx.stats.high_water == 16);
+        ctx.policy = RING_BUFFER_REJECT;
+        len = ring_buffer_put(&ctx, data, 10);
+        assert(len == 6);
+        len = ring_buffer_put(&ctx, data, 10);
+        assert(len == 0);
+        len = ring_buffer_skip(&ctx, 3);
+        assert(len == 3);
+        assert(ctx.stats.rejected == 14 && ctx.stats.total_in == 46 && ctx.stats.total_out == 9);
+    }
 
-    __bit_field_op(tbf1, clrPos, TEST_BIT_COUT, BF_OP_CLR);
-    __bit_field_check(tbf1, clrPos, TEST_BIT_COUT, BF_CHK_CLR);
+    // String queues drop whole strings, never half of one
+    {
+        char buffer[32];
+        char data[32];
+        struct string_queue_context ctx = STRING_QUEUE_STATIC_INIT(buffer);
+        for (uint32_t i = 0; i < 10; ++i)
+        {
+            sprintf(data, "entry %u", i);
+            uint32_t len = string_queue_put(&ctx, data);
+            assert(len == 8);
+        }
+        assert(ctx.stats.dropped == 6 && ctx.stats.total_in == 10 && ctx.stats.high_water == 32);
+        uint32_t len = string_queue_get(&ctx, data, sizeof(data));
+        assert(len == 8 && strcmp(data, "entry 6") == 0);
+        len = string_queue_put(&ctx, "this string is longer than the queue");
+        assert(len == 0);
+        ctx.policy = RING_BUFFER_REJECT;
+        len = string_queue_put(&ctx, "entry X");
+        assert(len == 8);
+        len = string_queue_put(&ctx, "x");
+        assert(len == 0);
+        assert(ctx.stats.rejected == 2 && ctx.stats.total_out == 1);
+
+        struct string_queue_context frame = STRING_QUEUE_STATIC_INIT(buffer);
+        for (uint32_t i = 0; i < 10; ++i)
+        {
+            sprintf(data, "frame %u", i);
+            len = string_queue_put_frame(&frame, data);
+            assert(len == STRING_QUEUE_FRAME_HEADER + 7);
+        }
+        assert(frame.stats.dropped == 8);
+        len = string_queue_put_frame(&frame, "a frame longer than the queue");
+        assert(len == 0 && frame.stats.rejected == 1 && frame.stats.dropped == 8);
+        for (uint32_t i = 8; i < 10; ++i)
+        {
+            char name[16];
+            sprintf(name, "frame %u", i);
+            int32_t entry = string_queue_get_frame(&frame, data, sizeof(data));
+            assert(entry == 7 && strcmp(data, name) == 0);
+        }
+        int32_t entry = string_queue_peek_frame(&frame);
+        assert(frame.stats.total_out == 2 && entry == -1);
+    }
+}
 
-    __bit_field_op(tbf1, setPos, TEST_BIT_COUT, BF_OP_CLR);
-    assert(tbf1.allZero());
+struct __FileRecord
+{
+    uint64_t seq;
+    uint64_t payload[6];
+    uint64_t check;
+};
 
-    __gen_pos_array(clrPos, TEST_BIT_COUT, 0, TOTAL_BIT_COUT);
-    __bit_field_op(tbf2, clrPos, TEST_BIT_COUT, BF_OP_CLR);
-    __bit_field_check(tbf2, clrPos, TEST_BIT_COUT, BF_CHK_CLR);
+void Test_FileMapping()
+{
+    static const char* RING_PATH = "TinyFileRingBuffer.test";
+    static const char* BITS_PATH = "TinyFileBitField.test";
+    static const uint32_t RING_SIZE = 256;
 
-    __bit_field_op(tbf2, setPos, TEST_BIT_COUT, BF_OP_SET);
-    __bit_field_check(tbf2, setPos, TEST_BIT_COUT, BF_CHK_SET);
+    remove(RING_PATH);
+    remove(BITS_PATH);
 
-    __bit_field_op(tbf2, setPos, TEST_BIT_COUT, BF_OP_CLR);
-    assert(tbf1.allZero());
+    // A ring resumes from the persisted cursors.
+    {
+        TinyFileRingBuffer< uint64_t > ring;
+        bool opened = ring.open(RING_PATH);
+        assert(!opened);
+        opened = ring.open(RING_PATH, RING_SIZE);
+        assert(opened);
+        for (uint64_t i = 0; i < 100; ++i) { bool stored = ring.put(i); assert(stored); }
+        bool synced = ring.sync();
+        assert(synced);
+    }
+    {
+        TinyFileRingBuffer< uint64_t > ring;
+        bool opened = ring.open(RING_PATH, RING_SIZE + 1);
+        assert(!opened);
+        opened = ring.open(RING_PATH);
+        assert(opened);
+        assert(ring.capacity() == RING_SIZE && ring.length() == 100);
+        for (uint64_t i = 0; i < 40; ++i) { uint64_t val = ring.get(); assert(val == i); }
+    }
+    {
+        TinyFileRingBuffer< uint64_t > ring;
+        bool opened = ring.open(RING_PATH, RING_SIZE);
+        assert(opened && ring.length() == 60);
+        uint64_t val = ring.get();
+        assert(val == 40);
+    }
+    {
+        TinyFileBitField wrongKind;
+        bool opened = wrongKind.open(RING_PATH);
+        assert(!opened);
+    }
+    remove(RING_PATH);
+
+    // A bit field reloads by mapping the file again.
+    {
+        TinyFileBitField bits;
+        bool opened = bits.open(BITS_PATH, 1000003);
+        assert(opened);
+        for (uint32_t i = 0; i < 1000003; i += 7) { bits.bitSet(i); }
+    }
+    {
+        TinyFileBitField bits;
+        bool opened = bits.open(BITS_PATH);
+        assert(opened);
+        assert(bits.capacity() == 1000003 && bits.count() == 1000003 / 7 + 1);
+        assert(bits.bitCheck(999999) && !bits.bitCheck(1000000));
+        assert(bits.findNextSet(7) == 14);
+    }
+    remove(BITS_PATH);
+
+#if !defined(_WIN32)
+    // Kill the writer mid-stream: every slot the reader gets after a restart is whole and in order.
+    TinyFileRingBuffer< __FileRecord > ring;
+    bool opened = ring.open(RING_PATH, RING_SIZE);
+    assert(opened);
+    pid_t writer = fork();
+    if (writer == 0)
+    {
+        TinyFileRingBuffer< __FileRecord > output;
+        if (!output.open(RING_PATH)) { _exit(1); }
+        for (uint64_t seq = 0; ; )
+        {
+            __FileRecord record;
+            record.seq = seq;
+            for (uint32_t i = 0; i < 6; ++i) { record.payload[i] = seq * 6 + i; }
+            record.check = ~seq;
+            if (output.put(record)) { ++seq; } else { std::this_thread::yield(); }
+        }
+    }
+
+    uint64_t expect = 0;
+    __FileRecord record;
+    while (expect < 10000)
+    {
+        if (!ring.get(record)) { std::this_thread::yield(); continue; }
+        assert(record.seq == expect && record.check == ~expect);
+        ++expect;
+    }
+    kill(writer, SIGKILL);
+    int status = 0;
+    waitpid(writer, &status, 0);
+    assert(WIFSIGNALED(status));
+    ring.close();
+
+    opened = ring.open(RING_PATH);
+    assert(opened && ring.length() <= RING_SIZE);
+    while (ring.get(record))
+    {
+        assert(record.seq == expect && record.check == ~expect);
+        for (uint32_t i = 0; i < 6; ++i) { assert(record.payload[i] == expect * 6 + i); }
+        ++expect;
+    }
+    ring.close();
+    remove(RING_PATH);
+#endif
+}
+
+void Test_SharedRingBuffer()
+{
+    static const char* NAME = "/TinySharedRingBuffer.test";
+    static const uint32_t RING_SIZE = 1000;
+    static const uint64_t TOTAL = 1000000;
+
+    TinySharedRingBuffer< uint64_t > producer, consumer;
+    TinySharedRingBuffer< uint64_t >::unlink(NAME);
+    bool early = consumer.open(NAME);
+    bool created = producer.create(NAME, RING_SIZE);
+    bool opened = consumer.open(NAME);
+    assert(!early && created && opened);
+    assert(consumer.capacity() == RING_SIZE);
+
+    // A blocking put into a full ring waits for the consumer and is not a rejection.
+    uint64_t block[RING_SIZE * 2];
+    uint64_t out[RING_SIZE * 2];
+    for (uint64_t i = 0; i < RING_SIZE * 2; ++i) { block[i] = i; }
+    SIZETYPE written = producer.write(block, RING_SIZE);
+    std::thread drain([&consumer]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        uint64_t head = 1;
+        bool got = consumer.get(head);
+        assert(got && head == 0);
+    });
+    bool stored = producer.put(RING_SIZE);
+    drain.join();
+    SIZETYPE readed = consumer.read(out, RING_SIZE * 2);
+    assert(written == RING_SIZE && stored && readed == RING_SIZE && out[RING_SIZE - 1] == RING_SIZE);
+    assert(producer.stats().rejected == 0 && producer.stats().totalIn == RING_SIZE + 1);
+
+    // Two mappings of the same memory, in non-blocking mode nothing waits.
+    producer.setBlocking(false);
+    consumer.setBlocking(false);
+    written = producer.write(block, RING_SIZE * 2);
+    stored = producer.put(0);
+    bool writable = producer.waitWritable(1);
+    assert(written == RING_SIZE && !stored && !writable);
+    assert(producer.stats().rejected == RING_SIZE + 1);
+    readed = consumer.read(out, RING_SIZE * 2);
+    SIZETYPE extra = consumer.read(out, 1);
+    bool readable = consumer.waitReadable(1);
+    assert(readed == RING_SIZE && extra == 0 && !readable);
+    for (uint64_t i = 0; i < RING_SIZE; ++i) { assert(out[i] == i); }
+
+#if !defined(_WIN32)
+    // A producer process hands a sequence over, both sides block on the ring.
+    consumer.setBlocking(true);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        TinySharedRingBuffer< uint64_t > writer;
+        if (!writer.open(NAME)) { _exit(1); }
+        uint64_t values[333];
+        for (uint64_t seq = 0; seq < TOTAL; )
+        {
+            uint64_t n = std::min< uint64_t >(333, TOTAL - seq);
+            for (uint64_t i = 0; i < n; ++i) { values[i] = seq + i; }
+            seq += writer.write(values, (SIZETYPE)n);
+            if (seq % 5 == 0) { writer.put(seq++); }
+        }
+        _exit(0);
+    }
+
+    for (uint64_t expect = 0; expect < TOTAL; )
+    {
+        SIZETYPE n = consumer.read(out, RING_SIZE);
+        assert(n > 0);
+        for (SIZETYPE i = 0; i < n; ++i, ++expect) { assert(out[i] == expect); }
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#endif
+
+    consumer.close();
+    producer.close();
+    bool unlinked = TinySharedRingBuffer< uint64_t >::unlink(NAME);
+    assert(unlinked);
+}
+
+
+void Test_Ringbuffer_C_Span()
+{
+    static const uint32_t loops = 100000;
+    static const uint32_t testBufferLen = 99;
+
+    uint8_t mainBuffer[testBufferLen];
+    ring_buffer_ctx rb_ctx;
+    ring_buffer_span spans[2];
+    ring_buffer_init(&rb_ctx, mainBuffer, testBufferLen);
+
+    uint8_t writeSeq = 0;
+    uint8_t readSeq = 0;
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t loop = 0; loop < loops; ++loop)
+    {
+        uint32_t space = testBufferLen - ring_buffer_len(&rb_ctx);
+        uint32_t reserveLen = (uint32_t)(rand() % (testBufferLen * 2));
+        uint32_t reserved = ring_buffer_reserve_write(&rb_ctx, reserveLen, spans);
+        assert(reserved == std::min(reserveLen, space));
+        assert(spans[0].len + spans[1].len == reserved);
+
+        uint32_t commitLen = reserved ? (uint32_t)(rand() % reserved + 1) : 0;
+        for (uint32_t i = 0; i < commitLen; ++i)
+        {
+            if (i < spans[0].len) { spans[0].data[i] = writeSeq++; }
+            else { spans[1].data[i - spans[0].len] = writeSeq++; }
+        }
+        ring_buffer_commit_write(&rb_ctx, commitLen);
+
+        uint32_t acquired = ring_buffer_acquire_read(&rb_ctx, spans);
+        assert(acquired == ring_buffer_len(&rb_ctx));
+        assert(spans[0].len + spans[1].len == acquired);
+        uint32_t releaseLen = acquired ? (uint32_t)(rand() % acquired + 1) : 0;
+        for (uint32_t i = 0; i < releaseLen; ++i)
+        {
+            uint8_t val = (i < spans[0].len) ? spans[0].data[i] : spans[1].data[i - spans[0].len];
+            assert(val == readSeq);
+            ++readSeq;
+        }
+        ring_buffer_release_read(&rb_ctx, releaseLen);
+        assert(ring_buffer_len(&rb_ctx) == acquired - releaseLen);
+    }
+}
+
+void __gen_pos_array(uint32_t* posArr, uint32_t count, uint32_t lower, uint32_t upper)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        // RAND_MAX may be as small as 32767, combine two calls to cover the whole range.
+        uint32_t randomVal = ((uint32_t)rand() << 15) ^ (uint32_t)rand();
+        posArr[i] = (randomVal % (upper - lower)) + lower;
+    }
+}
+
+#define BF_OP_SET 1
+#define BF_OP_CLR 2
+void __bit_field_op(TinyBitField& tbf, uint32_t* posArr, uint32_t count, uint8_t op)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (op == BF_OP_SET)
+        {
+            tbf.bitSet(posArr[i]);
+        }
+        else if (op == BF_OP_CLR)
+        {
+            tbf.bitClr(posArr[i]);
+        }
+        else
+        {
+            assert(false);
+        }
+    }
+}
+
+#define BF_CHK_SET 3
+#define BF_CHK_CLR 4
+void __bit_field_check(TinyBitField& tbf, uint32_t* posArr, uint32_t count, uint8_t op)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (op == BF_CHK_SET)
+        {
+            assert(tbf.bitCheck(posArr[i]));
+        }
+        else if (op == BF_CHK_CLR)
+        {
+            assert(!tbf.bitCheck(posArr[i]));
+        }
+    }
+}
+#define BF_CHK_OR 15
+#define BF_CHK_AND 16
+#define BF_CHK_XOR 17
+void __bit_field_check(TinyBitField& tbf, uint32_t* posArr1, uint32_t* posArr2, uint32_t count, uint8_t op)
+{
+}
+
+void __bit_field_random(BitField& bf, uint32_t percent)
+{
+    for (uint32_t i = 0; i < bf.capacity(); ++i)
+    {
+        if ((uint32_t)(rand() % 100) < percent) { bf.bitSet(i); }
+    }
+}
+
+// std::vector< BitField > only moves on reallocation when the move cannot throw.
+static_assert(std::is_nothrow_move_constructible< BitField >::value, "");
+static_assert(std::is_nothrow_move_assignable< BitField >::value, "");
+
+void Test_BitField_Logic()
+{
+    static const uint32_t capacities[] = { 1, 63, 64, 65, 1000, 100003 };
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t l = 0; l < sizeof(capacities) / sizeof(capacities[0]); ++l)
+    {
+        for (uint32_t r = 0; r < sizeof(capacities) / sizeof(capacities[0]); ++r)
+        {
+            BitField lhs(capacities[l]);
+            BitField rhs(capacities[r]);
+            __bit_field_random(lhs, 50);
+            __bit_field_random(rhs, 50);
+
+            BitField bfAnd(lhs); bfAnd.and(rhs);
+            BitField bfOr(lhs); bfOr.or(rhs);
+            BitField bfXor(lhs); bfXor.xor(rhs);
+            BitField bfNot(lhs); bfNot.not();
+
+            // Bits of lhs beyond the storage of rhs are left as they are.
+            for (uint32_t i = 0; i < lhs.capacity(); ++i)
+            {
+                bool a = lhs.bitCheck(i);
+                bool b = rhs.bitCheck(i);
+                bool inRhs = (i < rhs.wordCount() * 64);
+                assert(bfAnd.bitCheck(i) == (inRhs ? (a && b) : a));
+                assert(bfOr.bitCheck(i) == (a || b));
+                assert(bfXor.bitCheck(i) == (a != b));
+                assert(bfNot.bitCheck(i) == !a);
+            }
+            assert(!bfOr.allZero() || lhs.allZero());
+
+            bfNot.or(lhs);
+            bfNot.not();
+            assert(bfNot.allZero());
+        }
+    }
+}
+
+void Test_BitField_Expression()
+{
+    static const uint32_t capacities[] = { 1, 64, 70, 1000, 100003 };
+    static const uint32_t COUNT = sizeof(capacities) / sizeof(capacities[0]);
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t b = 0; b < COUNT; ++b)
+    {
+        for (uint32_t c = 0; c < COUNT; ++c)
+        {
+            BitField lhs(capacities[b]), mid(capacities[c]), rhs(capacities[(b + c) % COUNT]);
+            __bit_field_random(lhs, 50);
+            __bit_field_random(mid, 50);
+            __bit_field_random(rhs, 50);
+
+            // The fused pass must give what the in-place ops give, mixed capacities included.
+            BitField expect(lhs); expect.and(mid);
+            BitField inverted(rhs); inverted.not();
+            expect.or(inverted);
+
+            BitField fused = (lhs & mid) | ~rhs;
+            assert(fused.capacity() == expect.capacity());
+            assert(memcmp(fused.words(), expect.words(), expect.wordCount() * 8) == 0);
+
+            BitField assigned(1);
+            assigned = (lhs & mid) | ~rhs;
+            assert(memcmp(assigned.words(), expect.words(), expect.wordCount() * 8) == 0);
+
+            expect = lhs; expect.xor(mid); expect.and(rhs); expect.not();
+            fused = lhs;
+            fused = ~((fused ^ mid) & rhs);
+            assert(memcmp(fused.words(), expect.words(), expect.wordCount() * 8) == 0);
+
+            expect = lhs; expect.or(mid);
+            fused = lhs;
+            fused |= mid;
+            assert(memcmp(fused.words(), expect.words(), expect.wordCount() * 8) == 0);
+            fused ^= fused;
+            assert(fused.allZero());
+        }
+    }
+
+    // A move hands over the words without copying them.
+    BitField source(1000);
+    source.bitSet(999);
+    const uint64_t* words = source.words();
+    BitField moved(std::move(source));
+    assert(moved.words() == words && moved.bitCheck(999));
+    assert(source.words() == NULL && source.capacity() == 0);
+    source = std::move(moved);
+    assert(source.words() == words && moved.words() == NULL);
+}
+
+void Test_BitField_Parallel()
+{
+    static const uint32_t capacities[] = { 1, 1000, 64 * BitField::PARALLEL_MIN_WORDS + 5, 3 * 64 * BitField::PARALLEL_MIN_WORDS + 100 };
+
+    srand((unsigned)time(NULL));
+
+    TinyThreadPool pool(4);
+    std::atomic<uint32_t> ran(0);
+    pool.run(100, [&](uint32_t task) { ran += task; });
+    assert(ran == 4950);
+
+    for (uint32_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+    {
+        BitField lhs(capacities[c]), rhs(capacities[(c + 1) % 4]);
+        __bit_field_random(lhs, 50);
+        __bit_field_random(rhs, 50);
+
+        BitField serial(lhs), parallel(lhs);
+        assert(memcmp(serial.and(rhs).words(), parallel.parallelAnd(rhs, pool).words(), serial.wordCount() * 8) == 0);
+        assert(memcmp(serial.or(rhs).words(), parallel.parallelOr(rhs, pool).words(), serial.wordCount() * 8) == 0);
+        assert(memcmp(serial.xor(rhs).words(), parallel.parallelXor(rhs, pool).words(), serial.wordCount() * 8) == 0);
+        assert(memcmp(serial.not().words(), parallel.parallelNot(pool).words(), serial.wordCount() * 8) == 0);
+        assert(parallel.parallelCount(pool) == serial.count());
+        assert(parallel.parallelAllZero(pool) == serial.allZero());
+
+        parallel.zeroAll();
+        assert(parallel.parallelAllZero(pool));
+        parallel.bitSet(parallel.capacity() - 1);
+        assert(!parallel.parallelAllZero(pool));
+        assert(parallel.parallelCount(pool) == 1);
+    }
+}
+
+void Test_BitField_Find()
+{
+    static const uint32_t capacities[] = { 1, 63, 64, 65, 1000, 100003 };
+    static const uint32_t percents[] = { 0, 1, 50, 99, 100 };
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+    {
+        for (uint32_t p = 0; p < sizeof(percents) / sizeof(percents[0]); ++p)
+        {
+            BitField bf(capacities[c]);
+            __bit_field_random(bf, percents[p]);
+
+            uint32_t count = 0;
+            for (uint32_t i = 0; i < bf.capacity(); ++i)
+            {
+                if (bf.bitCheck(i)) { ++count; }
+            }
+            assert(bf.count() == count);
+
+            uint32_t iterated = 0;
+            uint32_t previous = 0;
+            for (uint32_t bit : bf)
+            {
+                assert(bf.bitCheck(bit));
+                assert((iterated == 0) || (bit > previous));
+                for (uint32_t i = (iterated == 0) ? 0 : previous + 1; i < bit; ++i)
+                {
+                    assert(!bf.bitCheck(i));
+                }
+                previous = bit;
+                ++iterated;
+            }
+            assert(iterated == count);
+
+            for (uint32_t loop = 0; loop < 100; ++loop)
+            {
+                uint32_t from = (uint32_t)(rand() % (bf.capacity() + 2));
+                uint32_t expectSet = from;
+                uint32_t expectClear = from;
+                while ((expectSet < bf.capacity()) && !bf.bitCheck(expectSet)) { ++expectSet; }
+                while ((expectClear < bf.capacity()) && bf.bitCheck(expectClear)) { ++expectClear; }
+                assert(bf.findFirstSet(from) == std::min<SIZETYPE>(expectSet, bf.capacity()));
+                assert(bf.findFirstClear(from) == std::min<SIZETYPE>(expectClear, bf.capacity()));
+            }
+        }
+    }
+}
+
+void Test_BitField_SetClr()
+{
+    const uint32_t TEST_BIT_COUT = 1000000;
+    const uint32_t TOTAL_BIT_COUT = 100000000;
+
+    BitField tbf1(TOTAL_BIT_COUT);
+    BitField tbf2(TOTAL_BIT_COUT);
+    uint32_t* setPos = new uint32_t[TEST_BIT_COUT];
+    uint32_t* clrPos = new uint32_t[TEST_BIT_COUT];
+
+    assert(tbf1.allZero());
+    assert(tbf2.allZero());
+
+    srand((unsigned)time(NULL));
+
+    __gen_pos_array(setPos, TEST_BIT_COUT, 0, TOTAL_BIT_COUT);
+    __bit_field_op(tbf1, setPos, TEST_BIT_COUT, BF_OP_SET);
+    __bit_field_check(tbf1, setPos, TEST_BIT_COUT, BF_CHK_SET);
+
+    __bit_field_op(tbf1, clrPos, TEST_BIT_COUT, BF_OP_CLR);
+    __bit_field_check(tbf1, clrPos, TEST_BIT_COUT, BF_CHK_CLR);
+
+    __bit_field_op(tbf1, setPos, TEST_BIT_COUT, BF_OP_CLR);
+    assert(tbf1.allZero());
+
+    __gen_pos_array(clrPos, TEST_BIT_COUT, 0, TOTAL_BIT_COUT);
+    __bit_field_op(tbf2, clrPos, TEST_BIT_COUT, BF_OP_CLR);
+    __bit_field_check(tbf2, clrPos, TEST_BIT_COUT, BF_CHK_CLR);
+
+    __bit_field_op(tbf2, setPos, TEST_BIT_COUT, BF_OP_SET);
+    __bit_field_check(tbf2, setPos, TEST_BIT_COUT, BF_CHK_SET);
+
+    __bit_field_op(tbf2, setPos, TEST_BIT_COUT, BF_OP_CLR);
+    assert(tbf1.allZero());
 
     //TinyBitField tbf_or(tbf1 & tbf2);
     //__bit_field_check(tbf_or, setPos, TEST_BIT_COUT, BF_CHK_SET);
@@ -403,24 +1815,1077 @@ void Test_BitField_SetClr()
     delete[] clrPos; clrPos = NULL;
 }
 
+void Test_HierarchicalBitField()
+{
+    static const uint32_t capacities[] = { 1, 64, 65, 4097, 262145, 1000003 };
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+    {
+        TinyHierarchicalBitField slots(capacities[c]);
+        TinyBitField reference(capacities[c]);
+        uint32_t capacity = slots.capacity();
+
+        assert(slots.findFirstSet() == capacity);
+        assert(slots.findFirstClear() == 0);
+
+        // Allocation hands out the lowest free slot until the field is full.
+        for (uint32_t i = 0; i < capacity; ++i)
+        {
+            uint32_t slot = slots.allocate();
+            assert(slot == i);
+            reference.bitSet(i);
+        }
+        uint32_t full = slots.allocate();
+        assert(full == capacity);
+        assert(slots.findFirstClear() == capacity);
+
+        for (uint32_t loop = 0; loop < 2000; ++loop)
+        {
+            uint32_t bit = (uint32_t)(((uint32_t)rand() << 15) ^ rand()) % capacity;
+            if (rand() % 2)
+            {
+                slots.release(bit);
+                reference.bitClr(bit);
+            }
+            else
+            {
+                uint32_t expect = reference.findFirstClear();
+                uint32_t slot = slots.allocate();
+                assert(slot == expect);
+                reference.bitSet(expect);
+            }
+
+            uint32_t from = (uint32_t)(((uint32_t)rand() << 15) ^ rand()) % (capacity + 2);
+            assert(slots.findFirstSet(from) == reference.findFirstSet(from));
+            assert(slots.findFirstClear(from) == reference.findFirstClear(from));
+        }
+
+        for (uint32_t i = 0; i < capacity; ++i) { slots.release(i); }
+        assert(slots.findFirstSet() == capacity);
+        uint32_t first = slots.allocate();
+        assert(first == 0);
+    }
+}
+
+// Fill both fields with the same bits: 0 sparse, 1 half, 2 long ranges, 3 nearly full.
+void __compressed_random(CompressedBitField& cbf, BitField& bf, uint32_t mode)
+{
+    for (uint32_t i = 0; i < bf.capacity(); ++i)
+    {
+        bool set = false;
+        if (mode == 0) { set = (rand() % 1000) == 0; }
+        else if (mode == 1) { set = (rand() % 2) == 0; }
+        else if (mode == 3) { set = (rand() % 100) != 0; }
+        else
+        {
+            uint32_t length = (uint32_t)(rand() % 5000) + 1;
+            set = (rand() % 2) == 0;
+            for (uint32_t end = (uint32_t)std::min<SIZETYPE>(i + length, bf.capacity()); i < end - 1; ++i)
+            {
+                if (set) { cbf.bitSet(i); bf.bitSet(i); }
+            }
+        }
+        if (set) { cbf.bitSet(i); bf.bitSet(i); }
+    }
+}
+
+void __compressed_check(const CompressedBitField& cbf, BitField& bf)
+{
+    assert(cbf.capacity() == bf.capacity());
+    assert(cbf.count() == bf.count());
+    assert(cbf.allZero() == bf.allZero());
+    for (uint32_t i = 0; i < bf.capacity() + 64; ++i)
+    {
+        assert(cbf.bitCheck(i) == bf.bitCheck(i));
+    }
+}
+
+void Test_CompressedBitField()
+{
+    static const uint32_t capacities[] = { 1, 65536, 65537, 200003 };
+    static const uint32_t MODES = 4;
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+    {
+        for (uint32_t m = 0; m < MODES * 2; ++m)
+        {
+            CompressedBitField clhs(capacities[c]), crhs(capacities[c]);
+            BitField lhs(capacities[c]), rhs(capacities[c]);
+            __compressed_random(clhs, lhs, m % MODES);
+            __compressed_random(crhs, rhs, (m / 2 + m) % MODES);
+            __compressed_check(clhs, lhs);
+
+            for (uint32_t loop = 0; loop < 1000; ++loop)
+            {
+                uint32_t bit = (uint32_t)(((uint32_t)rand() << 15) ^ rand()) % (capacities[c] + 10);
+                if (rand() % 2) { clhs.bitSet(bit); lhs.bitSet(bit); }
+                else { clhs.bitClr(bit); lhs.bitClr(bit); }
+            }
+            __compressed_check(clhs, lhs);
+
+            // The stored form must not change the bits, nor the results of the operations.
+            if (m >= MODES) { clhs.optimize(); crhs.optimize(); }
+            __compressed_check(clhs, lhs);
+            __compressed_check(crhs, rhs);
+
+            BitField expect(lhs);
+            __compressed_check(clhs & crhs, expect.and(rhs));
+            expect = lhs;
+            __compressed_check(clhs | crhs, expect.or(rhs));
+            expect = lhs;
+            __compressed_check(clhs ^ crhs, expect.xor(rhs));
+            expect = lhs;
+            __compressed_check(~clhs, expect.not());
+            expect = lhs;
+            __compressed_check(~clhs | clhs, expect.not().or(lhs));
+
+            CompressedBitField empty(capacities[c]);
+            assert(!(clhs ^ clhs));
+            assert((clhs & empty).allZero());
+            assert((clhs | empty).count() == lhs.count());
+        }
+    }
+
+    // A field narrower than the operand keeps its own capacity.
+    CompressedBitField narrow(100), wide(200000);
+    wide.bitSet(10); wide.bitSet(99); wide.bitSet(100); wide.bitSet(150000);
+    narrow.or(wide);
+    assert(narrow.count() == 2 && narrow.bitCheck(99) && !narrow.bitCheck(100));
+
+    // Memory follows the set bits, not the capacity.
+    CompressedBitField sparse(100000000);
+    for (uint32_t i = 0; i < 1000; ++i) { sparse.bitSet(i * 99991); }
+    assert(sparse.memoryUsage() < 200000);
+    sparse.not();
+    sparse.optimize();
+    assert(sparse.count() == 100000000 - 1000);
+    assert(sparse.memoryUsage() < 200000);
+
+    // A bit flipping at ARRAY_MAX keeps the bitset, only ARRAY_MIN or optimize() turn it back into an array.
+    CompressedBitField flip(CompressedBitField::CHUNK_BITS);
+    for (uint32_t i = 0; i <= CompressedBitField::ARRAY_MAX; ++i) { flip.bitSet(i * 2); }
+    assert(flip.chunkType(0) == CompressedBitField::CONTAINER_BITSET);
+    for (uint32_t loop = 0; loop < 1000; ++loop)
+    {
+        flip.bitClr(0);
+        assert(!flip.bitCheck(0) && flip.chunkType(0) == CompressedBitField::CONTAINER_BITSET);
+        flip.bitSet(0);
+        assert(flip.bitCheck(0) && flip.chunkType(0) == CompressedBitField::CONTAINER_BITSET);
+    }
+    for (uint32_t i = 0; i < 100; ++i) { flip.bitClr(i * 2); }
+    assert(flip.count() == CompressedBitField::ARRAY_MAX - 99 && flip.chunkType(0) == CompressedBitField::CONTAINER_BITSET);
+    flip.optimize();
+    assert(flip.count() == CompressedBitField::ARRAY_MAX - 99 && flip.chunkType(0) == CompressedBitField::CONTAINER_ARRAY);
+    for (uint32_t i = 0; i < 100; ++i) { flip.bitSet(i * 2); }
+    assert(flip.chunkType(0) == CompressedBitField::CONTAINER_BITSET);
+    for (uint32_t i = 0; i < CompressedBitField::ARRAY_MAX - CompressedBitField::ARRAY_MIN; ++i) { flip.bitClr(i * 2); }
+    assert(flip.count() == CompressedBitField::ARRAY_MIN + 1 && flip.chunkType(0) == CompressedBitField::CONTAINER_BITSET);
+    flip.bitClr((CompressedBitField::ARRAY_MAX - CompressedBitField::ARRAY_MIN) * 2);
+    assert(flip.count() == CompressedBitField::ARRAY_MIN && flip.chunkType(0) == CompressedBitField::CONTAINER_ARRAY);
+    for (uint32_t i = 0; i <= CompressedBitField::ARRAY_MAX; ++i) { assert(flip.bitCheck(i * 2) == (i > CompressedBitField::ARRAY_MAX - CompressedBitField::ARRAY_MIN)); }
+}
+
+void Test_AtomicBitField()
+{
+    static const uint32_t TOTAL_BIT_COUT = 100003;
+    static const uint32_t THREADS = 4;
+
+    TinyAtomicBitField field(TOTAL_BIT_COUT);
+    std::vector<std::thread> workers;
+
+    // Neighbouring bits of the same word, each set and cleared by a different thread.
+    for (uint32_t t = 0; t < THREADS; ++t)
+    {
+        workers.push_back(std::thread([&field, t]() {
+            for (uint32_t i = t; i < TOTAL_BIT_COUT; i += THREADS) { field.bitSet(i); }
+        }));
+    }
+    for (uint32_t t = 0; t < THREADS; ++t) { workers[t].join(); }
+    workers.clear();
+    assert(field.count() == TOTAL_BIT_COUT);
+
+    for (uint32_t t = 0; t < THREADS; ++t)
+    {
+        workers.push_back(std::thread([&field, t]() {
+            for (uint32_t i = t; i < TOTAL_BIT_COUT; i += THREADS) { if (i % 3) { field.bitClr(i); } }
+        }));
+    }
+    for (uint32_t t = 0; t < THREADS; ++t) { workers[t].join(); }
+    workers.clear();
+    for (uint32_t i = 0; i < TOTAL_BIT_COUT; ++i) { assert(field.bitCheck(i) == (i % 3 == 0)); }
+
+    // Every thread tries every bit, each bit is won exactly once.
+    field.zeroAll();
+    std::atomic<uint32_t> won(0);
+    for (uint32_t t = 0; t < THREADS; ++t)
+    {
+        workers.push_back(std::thread([&field, &won]() {
+            uint32_t mine = 0;
+            for (uint32_t i = 0; i < TOTAL_BIT_COUT; ++i) { if (!field.testAndSet(i)) { ++mine; } }
+            won += mine;
+        }));
+    }
+    for (uint32_t t = 0; t < THREADS; ++t) { workers[t].join(); }
+    workers.clear();
+    assert(won == TOTAL_BIT_COUT);
+    bool wasSet = field.testAndClr(7);
+    bool stillSet = field.testAndClr(7);
+    assert(wasSet && !stillSet);
+
+    // Slots claimed by findFirstClearAndSet are unique and cover the field.
+    field.zeroAll();
+    std::vector< std::vector<uint32_t> > claimed(THREADS);
+    for (uint32_t t = 0; t < THREADS; ++t)
+    {
+        workers.push_back(std::thread([&field, &claimed, t]() {
+            for (uint32_t slot; (slot = field.findFirstClearAndSet()) != TOTAL_BIT_COUT; ) { claimed[t].push_back(slot); }
+        }));
+    }
+    for (uint32_t t = 0; t < THREADS; ++t) { workers[t].join(); }
+    std::vector<uint32_t> all;
+    for (uint32_t t = 0; t < THREADS; ++t) { all.insert(all.end(), claimed[t].begin(), claimed[t].end()); }
+    std::sort(all.begin(), all.end());
+    assert(all.size() == TOTAL_BIT_COUT);
+    for (uint32_t i = 0; i < TOTAL_BIT_COUT; ++i) { assert(all[i] == i); }
+
+    field.bitClr(TOTAL_BIT_COUT - 1);
+    field.bitClr(70);
+    uint32_t last = field.findFirstClearAndSet(71);
+    uint32_t first = field.findFirstClearAndSet();
+    uint32_t none = field.findFirstClearAndSet();
+    assert(last == TOTAL_BIT_COUT - 1 && first == 70 && none == TOTAL_BIT_COUT);
+}
+
+#if defined(TINY_LARGE_CAPACITY)
+void Test_LargeCapacity()
+{
+    static const SIZETYPE TOTAL_BIT_COUT = ((SIZETYPE)1 << 32) + 130;
+
+    // 512 MB of bits, the positions above 4G must not wrap.
+    TinyBitField tbf(TOTAL_BIT_COUT);
+    assert(tbf.capacity() == TOTAL_BIT_COUT);
+    assert(tbf.wordCount() == TOTAL_BIT_COUT / 64 + 1);
+
+    tbf.bitSet(TOTAL_BIT_COUT - 1);
+    tbf.bitSet(128);
+    assert(tbf.bitCheck(TOTAL_BIT_COUT - 1) && !tbf.bitCheck(TOTAL_BIT_COUT - 1 - ((SIZETYPE)1 << 32)));
+    assert(tbf.findFirstSet(130) == TOTAL_BIT_COUT - 1);
+    assert(tbf.findNextSet(TOTAL_BIT_COUT - 1) == TOTAL_BIT_COUT);
+    assert(tbf.count() == 2);
+
+    assert(TinyModuloIndex::slot(((uint64_t)1 << 33) + 5, ((SIZETYPE)1 << 32) + 1) == 3);
+}
+#endif
+
+/*****************************************************************************/
+/*                                Benchmarks                                 */
+/*****************************************************************************/
+
+// TSC ticks where available, nanoseconds otherwise
+uint64_t __cycles()
+{
+#if defined(TINY_HAS_RDTSC)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+double __elapsed_seconds(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+}
+
+void Benchmark_SpscRingBuffer()
+{
+    static const uint32_t loops = 20000000;
+
+    double spscOps = 0.0;
+    {
+        TinySpscRingBuffer< uint32_t, 1024 > spsc;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::thread producer([&spsc]()
+        {
+            for (uint32_t i = 0; i < loops; )
+            {
+                if (spsc.put(i)) { ++i; } else { std::this_thread::yield(); }
+            }
+        });
+        uint32_t val = 0;
+        for (uint32_t i = 0; i < loops; )
+        {
+            if (spsc.get(val)) { ++i; } else { std::this_thread::yield(); }
+        }
+        producer.join();
+        spscOps = loops / __elapsed_seconds(start);
+    }
+
+    double mutexOps = 0.0;
+    {
+        std::mutex lock;
+        TinyRingBuffer< uint32_t, 1024 > ring;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::thread producer([&ring, &lock]()
+        {
+            for (uint32_t i = 0; i < loops; )
+            {
+                bool done = false;
+                {
+                    std::lock_guard< std::mutex > guard(lock);
+                    if (ring.length() < ring.capacity()) { ring.put(i); done = true; }
+                }
+                if (done) { ++i; } else { std::this_thread::yield(); }
+            }
+        });
+        for (uint32_t i = 0; i < loops; )
+        {
+            bool done = false;
+            {
+                std::lock_guard< std::mutex > guard(lock);
+                if (!ring.end()) { ring.get(); done = true; }
+            }
+            if (done) { ++i; } else { std::this_thread::yield(); }
+        }
+        producer.join();
+        mutexOps = loops / __elapsed_seconds(start);
+    }
+
+    printf("Benchmark_SpscRingBuffer \t\t\t\t| SPSC %.1f Mops/s | Mutex %.1f Mops/s |\n", spscOps / 1e6, mutexOps / 1e6);
+}
+
+void Benchmark_MpmcRingBuffer()
+{
+    static const uint32_t loops = 4000000;
+
+    for (uint32_t threads = 1; threads <= 16; threads *= 2)
+    {
+        // threads producers and threads consumers share the same total work
+        double mpmcOps = 0.0;
+        {
+            TinyMpmcRingBuffer< uint32_t, 1024 > queue;
+            std::vector< std::thread > workers;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (uint32_t t = 0; t < threads; ++t)
+            {
+                workers.push_back(std::thread([&queue, threads]()
+                {
+                    for (uint32_t i = 0; i < loops / threads; ) { if (queue.put(i)) { ++i; } else { std::this_thread::yield(); } }
+                }));
+                workers.push_back(std::thread([&queue, threads]()
+                {
+                    uint32_t val = 0;
+                    for (uint32_t i = 0; i < loops / threads; ) { if (queue.get(val)) { ++i; } else { std::this_thread::yield(); } }
+                }));
+            }
+            for (uint32_t t = 0; t < workers.size(); ++t) { workers[t].join(); }
+            mpmcOps = loops / __elapsed_seconds(start);
+        }
+
+        double mutexOps = 0.0;
+        {
+            std::mutex lock;
+            TinyRingBuffer< uint32_t, 1024 > ring;
+            std::vector< std::thread > workers;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (uint32_t t = 0; t < threads; ++t)
+            {
+                workers.push_back(std::thread([&ring, &lock, threads]()
+                {
+                    for (uint32_t i = 0; i < loops / threads; )
+                    {
+                        bool done = false;
+                        {
+                            std::lock_guard< std::mutex > guard(lock);
+                            if (ring.length() < ring.capacity()) { ring.put(i); done = true; }
+                        }
+                        if (done) { ++i; } else { std::this_thread::yield(); }
+                    }
+                }));
+                workers.push_back(std::thread([&ring, &lock, threads]()
+                {
+                    for (uint32_t i = 0; i < loops / threads; )
+                    {
+                        bool done = false;
+                        {
+                            std::lock_guard< std::mutex > guard(lock);
+                            if (!ring.end()) { ring.get(); done = true; }
+                        }
+                        if (done) { ++i; } else { std::this_thread::yield(); }
+                    }
+                }));
+            }
+            for (uint32_t t = 0; t < workers.size(); ++t) { workers[t].join(); }
+            mutexOps = loops / __elapsed_seconds(start);
+        }
+
+        printf("Benchmark_MpmcRingBuffer %2u+%-2u threads \t\t| MPMC %.1f Mops/s | Mutex %.1f Mops/s |\n",
+            threads, threads, mpmcOps / 1e6, mutexOps / 1e6);
+    }
+}
+
+void Benchmark_SharedRingBuffer()
+{
+#if !defined(_WIN32)
+    static const char* NAME = "/TinySharedRingBuffer.bench";
+    static const uint32_t RING_SIZE = 4 * 1024 * 1024;
+    static const uint32_t BLOCK_SIZE = 64 * 1024;
+    static const uint64_t TOTAL = 2ULL * 1024 * 1024 * 1024;
+
+    TinySharedRingBuffer< uint8_t > consumer;
+    if (!consumer.create(NAME, RING_SIZE)) { return; }
+    std::vector< uint8_t > block(BLOCK_SIZE, 0x5A);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        TinySharedRingBuffer< uint8_t > producer;
+        if (!producer.open(NAME)) { _exit(1); }
+        for (uint64_t sent = 0; sent < TOTAL; sent += BLOCK_SIZE) { producer.write(&block[0], BLOCK_SIZE); }
+        _exit(0);
+    }
+
+    uint64_t received = 0;
+    while (received < TOTAL) { received += consumer.read(&block[0], BLOCK_SIZE); }
+    double seconds = __elapsed_seconds(start);
+    waitpid(child, NULL, 0);
+    consumer.close();
+    TinySharedRingBuffer< uint8_t >::unlink(NAME);
+
+    printf("Benchmark_SharedRingBuffer 2 GB \t\t| %.2f GB/s between processes |\n", TOTAL / seconds / 1e9);
+#endif
+}
+
+void Benchmark_CircularBuffer()
+{
+    static const uint32_t dataLen = 10000000;
+    static const uint32_t bufferLen = 999;
+
+    uint8_t* data = new uint8_t[dataLen];
+    uint8_t* compare = new uint8_t[dataLen];
+    for (uint32_t i = 0; i < dataLen; ++i)
+    {
+        data[i] = (uint8_t)i;
+    }
+    memset(compare, 0, dataLen);
+
+    double blockSeconds = 0.0;
+    {
+        TinyCircularBuffer ringbuffer(bufferLen);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t pos = 0, chunk = 1; pos < dataLen; pos += chunk, chunk = chunk % bufferLen + 1)
+        {
+            chunk = std::min(chunk, dataLen - pos);
+            ringbuffer.write(data + pos, chunk);
+            ringbuffer.read(compare + pos, chunk);
+        }
+        blockSeconds = __elapsed_seconds(start);
+        assert(memcmp(data, compare, dataLen) == 0);
+    }
+
+    double byteSeconds = 0.0;
+    {
+        TinyCircularBuffer ringbuffer(bufferLen);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t pos = 0, chunk = 1; pos < dataLen; pos += chunk, chunk = chunk % bufferLen + 1)
+        {
+            chunk = std::min(chunk, dataLen - pos);
+            for (uint32_t i = 0; i < chunk; ++i) { ringbuffer.put(data[pos + i]); }
+            for (uint32_t i = 0; i < chunk; ++i) { compare[pos + i] = ringbuffer.get(); }
+        }
+        byteSeconds = __elapsed_seconds(start);
+        assert(memcmp(data, compare, dataLen) == 0);
+    }
+
+    printf("Benchmark_CircularBuffer \t\t\t\t| Block %.1f MB/s | Byte %.1f MB/s |\n",
+        dataLen / blockSeconds / 1e6, dataLen / byteSeconds / 1e6);
+
+    delete[] data; data = NULL;
+    delete[] compare; compare = NULL;
+}
+
+void Benchmark_MirroredCircularBuffer()
+{
+#if defined(__linux__)
+    static const uint32_t dataLen = 10000000;
+    static const uint32_t bufferLen = 4096;
+
+    // A stream of messages, one length byte and up to 255 bytes of payload, summed by a parser that wants one range
+    std::vector< uint8_t > data(dataLen);
+    for (uint32_t pos = 0; pos < dataLen; )
+    {
+        uint32_t len = std::min< uint32_t >((uint32_t)(rand() % 256), dataLen - pos - 1);
+        data[pos] = (uint8_t)len;
+        for (uint32_t i = 1; i <= len; ++i) { data[pos + i] = (uint8_t)(pos + i); }
+        pos += len + 1;
+    }
+    uint64_t expected = 0;
+    for (uint32_t pos = 0; pos < dataLen; pos += data[pos] + 1) { expected += data[pos]; for (uint32_t i = 1; i <= data[pos]; ++i) { expected += data[pos + i]; } }
+
+    double copySeconds = 0.0;
+    {
+        TinyCircularBuffer ringbuffer(bufferLen);
+        uint8_t message[256];
+        uint64_t sum = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t pos = 0; pos < dataLen; )
+        {
+            pos += ringbuffer.write(data.data() + pos, std::min< uint32_t >(bufferLen - ringbuffer.length(), dataLen - pos));
+            while ((ringbuffer.length() > 0) && (ringbuffer.length() > ringbuffer.peek(0)))
+            {
+                uint32_t len = ringbuffer.peek(0) + 1u;
+                ringbuffer.read(message, len);
+                for (uint32_t i = 0; i < len; ++i) { sum += message[i]; }
+            }
+        }
+        copySeconds = __elapsed_seconds(start);
+        assert(sum == expected);
+    }
+
+    double mirrorSeconds = 0.0;
+    {
+        TinyMirroredCircularBuffer ringbuffer;
+        bool created = ringbuffer.create(bufferLen);
+        assert(created && ringbuffer.capacity() == bufferLen);
+        uint64_t sum = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t pos = 0; pos < dataLen; )
+        {
+            pos += ringbuffer.write(data.data() + pos, std::min< uint32_t >(bufferLen - ringbuffer.length(), dataLen - pos));
+            TinySpanPair< uint8_t > readable = ringbuffer.acquireRead();
+            uint32_t parsed = 0;
+            while ((parsed < readable.first.length) && (readable.first.length - parsed > readable.first.data[parsed]))
+            {
+                uint32_t len = readable.first.data[parsed] + 1u;
+                for (uint32_t i = 0; i < len; ++i) { sum += readable.first.data[parsed + i]; }
+                parsed += len;
+            }
+            ringbuffer.releaseRead(parsed);
+        }
+        mirrorSeconds = __elapsed_seconds(start);
+        assert(sum == expected);
+    }
+
+    printf("Benchmark_MirroredCircularBuffer \t\t\t| copy out %.1f MB/s | in place %.1f MB/s |\n",
+        dataLen / copySeconds / 1e6, dataLen / mirrorSeconds / 1e6);
+#endif
+}
+
+void Benchmark_Ringbuffer_C()
+{
+    static const uint32_t dataLen = 10000000;
+    static const uint32_t bufferLen = 999;
+
+    uint8_t* data = new uint8_t[dataLen];
+    uint8_t* compare = new uint8_t[dataLen];
+    uint8_t* buffer = new uint8_t[bufferLen];
+    for (uint32_t i = 0; i < dataLen; ++i)
+    {
+        data[i] = (uint8_t)i;
+    }
+
+    // One byte per call pays the modulo, overflow check and rebase the old loops ran per byte, plus the call
+    ring_buffer_ctx ctx;
+    ring_buffer_init(&ctx, buffer, bufferLen);
+    memset(compare, 0, dataLen);
+    uint64_t start = __cycles();
+    for (uint32_t pos = 0, chunk = 1; pos < dataLen; pos += chunk, chunk = chunk % bufferLen + 1)
+    {
+        chunk = std::min(chunk, dataLen - pos);
+        for (uint32_t i = 0; i < chunk; ++i) { ring_buffer_put(&ctx, data + pos + i, 1); }
+        for (uint32_t i = 0; i < chunk; ++i) { ring_buffer_get(&ctx, compare + pos + i, 1); }
+    }
+    double byteCycles = (double)(__cycles() - start) / dataLen;
+    assert(memcmp(data, compare, dataLen) == 0);
+
+    ring_buffer_init(&ctx, buffer, bufferLen);
+    memset(compare, 0, dataLen);
+    start = __cycles();
+    for (uint32_t pos = 0, chunk = 1; pos < dataLen; pos += chunk, chunk = chunk % bufferLen + 1)
+    {
+        chunk = std::min(chunk, dataLen - pos);
+        ring_buffer_put(&ctx, data + pos, chunk);
+        ring_buffer_get(&ctx, compare + pos, chunk);
+    }
+    double blockCycles = (double)(__cycles() - start) / dataLen;
+    assert(memcmp(data, compare, dataLen) == 0);
+
+    printf("Benchmark_Ringbuffer_C %s per byte \t\t| Byte %.2f | Block %.3f |\n",
+#if defined(TINY_HAS_RDTSC)
+        "cycles", byteCycles, blockCycles);
+#else
+        "ns", byteCycles, blockCycles);
+#endif
+
+    delete[] data; data = NULL;
+    delete[] compare; compare = NULL;
+    delete[] buffer; buffer = NULL;
+}
+
+template< class RING >
+double __ring_put_get_seconds(RING& ring, uint32_t loops)
+{
+    uint64_t sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i)
+    {
+        ring.put(i);
+        ring.put(i);
+        sum += ring.get();
+        sum += ring.peek(ring.length() - 1);
+    }
+    double seconds = __elapsed_seconds(start);
+    assert(sum != 0);
+    return seconds;
+}
+
+template< uint32_t SIZE >
+void __bench_ring_index(uint32_t loops)
+{
+    uint32_t* data = new uint32_t[SIZE];
+    uint64_t rPos = 0;
+    uint64_t wPos = 0;
+    TinyRingBufferShell< uint32_t > generic;
+    generic.init(data, SIZE, &rPos, &wPos);
+    TinyRingBuffer< uint32_t, SIZE >* specialized = new TinyRingBuffer< uint32_t, SIZE >();
+
+    double genericSeconds = __ring_put_get_seconds(generic, loops);
+    double specializedSeconds = __ring_put_get_seconds(*specialized, loops);
+
+    printf("Benchmark_RingBufferIndex SIZE = %-5u \t\t| Generic %.1f Mops/s | Static %.1f Mops/s |\n",
+        SIZE, loops / genericSeconds / 1e6, loops / specializedSeconds / 1e6);
+
+    delete specialized; specialized = NULL;
+    delete[] data; data = NULL;
+}
+
+void Benchmark_RingBufferIndex()
+{
+    static const uint32_t loops = 20000000;
+
+    __bench_ring_index< 64 >(loops);
+    __bench_ring_index< 1000 >(loops);
+    __bench_ring_index< 1024 >(loops);
+    __bench_ring_index< 4096 >(loops);
+    __bench_ring_index< 65536 >(loops);
+}
+
+uint8_t __byte_do_and(uint8_t lhs, uint8_t rhs) { return lhs & rhs; }
+uint8_t(*volatile __byte_calc)(uint8_t, uint8_t) = __byte_do_and;
+
+void __byte_and(uint8_t* dst, const uint8_t* src, uint32_t len)
+{
+    uint8_t(*calc)(uint8_t, uint8_t) = __byte_calc;
+    for (uint32_t i = 0; i < len; ++i) { dst[i] = calc(dst[i], src[i]); }
+}
+
+void Benchmark_StringQueue()
+{
+    static const uint32_t messages = 1000000;
+    static const uint32_t batch = 32;
+    std::vector<std::string> lines(256);
+    std::vector<const char*> ptrs(lines.size());
+    for (uint32_t i = 0; i < lines.size(); ++i)
+    {
+        lines[i] = "2024-01-01 12:00:00 INFO worker " + std::to_string(i) + " " + std::string(i % 64, 'x');
+        ptrs[i] = lines[i].c_str();
+    }
+    std::vector<char> buffer(16384);
+    char data[4096];
+    char* out[batch];
+    uint64_t bytes = 0, check = 0;
+
+    struct string_queue_context ctx;
+    string_queue_init(&ctx, &buffer[0], (uint32_t)buffer.size());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < messages; i += batch)
+    {
+        for (uint32_t j = 0; j < batch; ++j) { bytes += string_queue_put(&ctx, ptrs[(i + j) & 255]); }
+        for (uint32_t j = 0; j < batch; ++j) { check += string_queue_get(&ctx, data, sizeof(data)); }
+    }
+    double legacySeconds = __elapsed_seconds(start);
+    assert(check == bytes);
+
+    ctx.rpos = ctx.wpos = 0;
+    check = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < messages; i += batch)
+    {
+        for (uint32_t j = 0; j < batch; ++j) { string_queue_put_frame(&ctx, ptrs[(i + j) & 255]); }
+        for (uint32_t j = 0; j < batch; ++j) { check += string_queue_get_frame(&ctx, data, sizeof(data)) + 1; }
+    }
+    double frameSeconds = __elapsed_seconds(start);
+    assert(check == bytes);
+
+    ctx.rpos = ctx.wpos = 0;
+    check = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < messages; i += batch)
+    {
+        string_queue_put_batch(&ctx, &ptrs[i & 255], batch);
+        uint32_t count = string_queue_get_batch(&ctx, data, sizeof(data), out, batch);
+        for (uint32_t j = 0; j < count; ++j) { check += strlen(out[j]) + 1; }
+    }
+    double batchSeconds = __elapsed_seconds(start);
+    assert(check == bytes);
+
+    printf("Benchmark_StringQueue %.0f MB \t\t\t| Legacy %.1f MB/s | Framed %.1f MB/s | Batch %.1f MB/s |\n", bytes / 1e6,
+        bytes / legacySeconds / 1e6, bytes / frameSeconds / 1e6, bytes / batchSeconds / 1e6);
+}
+
+void Benchmark_StringIndex()
+{
+    static const uint32_t loops = 2000000;
+    static const uint32_t names = 4096;
+    // Keys the legacy 64 byte dictionary can hold, interned by Test_StringToIndex
+    const char* keys[] = { "index_xxx_01", "index_xxxx_02", "index_xxxxxxx_03", "index_xxxxx_04", "in" };
+    const uint32_t keyCount = sizeof(keys) / sizeof(keys[0]);
+
+    int64_t sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i)
+    {
+        sum += string_to_index(keys[i % keyCount]);
+    }
+    double legacySeconds = __elapsed_seconds(start);
+
+    std::vector<uint8_t> buffer(STRING_INDEX_CONTEXT_SIZE(names, names * 24));
+    struct string_index_context ctx;
+    string_index_init(&ctx, &buffer[0], (uint32_t)buffer.size(), names);
+    for (uint32_t i = 0; i < keyCount; ++i)
+    {
+        string_index_put(&ctx, keys[i]);
+    }
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i)
+    {
+        sum -= string_index_put(&ctx, keys[i % keyCount]);
+    }
+    double hashSeconds = __elapsed_seconds(start);
+    assert(sum == 0);
+
+    std::vector<std::string> metrics(names);
+    for (uint32_t i = 0; i < names; ++i)
+    {
+        char name[32];
+        sprintf(name, "service.metric.%u", i);
+        metrics[i] = name;
+    }
+    string_index_clear(&ctx);
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i)
+    {
+        sum += string_index_put(&ctx, metrics[i % names].c_str());
+    }
+    double manySeconds = __elapsed_seconds(start);
+    assert(ctx.count == names);
+
+    printf("Benchmark_StringIndex \t\t\t\t\t| 5 keys legacy %.1f Mops/s | hash %.1f Mops/s | 4096 keys hash %.1f Mops/s |\n",
+        loops / legacySeconds / 1e6, loops / hashSeconds / 1e6, loops / manySeconds / 1e6);
+}
+
+void Benchmark_BitField()
+{
+    static const uint32_t TOTAL_BIT_COUT = 100000000;
+    static const uint32_t loops = 10;
+
+    BitField lhs(TOTAL_BIT_COUT);
+    BitField rhs(TOTAL_BIT_COUT);
+    lhs.not();
+    rhs.not();
+
+    // A function pointer call per byte is what BitField did before it moved to words.
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { __byte_and((uint8_t*)lhs.words(), (const uint8_t*)rhs.words(), lhs.wordCount() * 8); }
+    double byteSeconds = __elapsed_seconds(start) / loops;
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { TinyBitKernel< TinyBitScalar >::opAnd(lhs.words(), rhs.words(), lhs.wordCount()); }
+    double wordSeconds = __elapsed_seconds(start) / loops;
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { lhs.and(rhs); }
+    double vectorSeconds = __elapsed_seconds(start) / loops;
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { lhs.not(); }
+    double notSeconds = __elapsed_seconds(start) / loops;
+
+    // Through a volatile pointer the scan cannot be hoisted out of the loop, the sink keeps its result.
+    lhs.zeroAll();
+    BitField* volatile field = &lhs;
+    volatile uint32_t zeros = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { zeros += field->allZero() ? 1 : 0; }
+    double zeroSeconds = __elapsed_seconds(start) / loops;
+    assert(zeros == loops);
+
+    printf("Benchmark_BitField and 10^8 bits \t\t| Byte %.2f ms | Word %.2f ms | Vector %.2f ms |\n",
+        byteSeconds * 1e3, wordSeconds * 1e3, vectorSeconds * 1e3);
+    printf("Benchmark_BitField not / allZero 10^8 bits \t| %.2f ms | %.2f ms |\n", notSeconds * 1e3, zeroSeconds * 1e3);
+}
+
+void Benchmark_BitField_Expression()
+{
+    static const uint32_t TOTAL_BIT_COUT = 100000000;
+    static const uint32_t loops = 10;
+
+    BitField a(TOTAL_BIT_COUT), b(TOTAL_BIT_COUT), c(TOTAL_BIT_COUT), d(TOTAL_BIT_COUT);
+    b.not();
+
+    // What a = (b & c) | ~d cost when every operator made a copy.
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i)
+    {
+        BitField bc(b); bc.and(c);
+        BitField notD(d); notD.not();
+        bc.or(notD);
+        a = bc;
+    }
+    double copySeconds = __elapsed_seconds(start) / loops;
+    assert(a.count() == TOTAL_BIT_COUT);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { a = (b & c) | ~d; }
+    double fusedSeconds = __elapsed_seconds(start) / loops;
+    assert(a.count() == TOTAL_BIT_COUT);
+
+    printf("Benchmark_BitField (b & c) | ~d 10^8 bits \t| Copies %.2f ms | Fused %.2f ms |\n",
+        copySeconds * 1e3, fusedSeconds * 1e3);
+}
+
+void Benchmark_BitField_Parallel()
+{
+    static const uint32_t TOTAL_BIT_COUT = 400000000;
+    static const uint32_t loops = 5;
+
+    BitField lhs(TOTAL_BIT_COUT), rhs(TOTAL_BIT_COUT);
+    rhs.not();
+
+    uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t threads = 1; threads <= cores; ++threads)
+    {
+        TinyThreadPool pool(threads);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < loops; ++i) { lhs.parallelOr(rhs, pool); }
+        double orSeconds = __elapsed_seconds(start) / loops;
+
+        SIZETYPE count = 0;
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < loops; ++i) { count = lhs.parallelCount(pool); }
+        double countSeconds = __elapsed_seconds(start) / loops;
+        assert(count == TOTAL_BIT_COUT);
+
+        printf("Benchmark_BitField_Parallel 4*10^8 bits %2u threads \t| or %.2f ms | count %.2f ms |\n",
+            threads, orSeconds * 1e3, countSeconds * 1e3);
+    }
+}
+
+void Benchmark_BitField_Find()
+{
+    static const uint32_t TOTAL_BIT_COUT = 10000000;
+    static const uint32_t loops = 100;
+
+    // A mostly-full slot map with the only free slot near the end.
+    BitField slots(TOTAL_BIT_COUT);
+    slots.not();
+    slots.bitClr(TOTAL_BIT_COUT - 100);
+
+    uint32_t found = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { found = slots.findFirstClear(); }
+    double findSeconds = __elapsed_seconds(start) / loops;
+    assert(found == TOTAL_BIT_COUT - 100);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i) { found = slots.count(); }
+    double countSeconds = __elapsed_seconds(start) / loops;
+    assert(found == TOTAL_BIT_COUT - 1);
+
+    start = std::chrono::steady_clock::now();
+    for (found = 0; (found < TOTAL_BIT_COUT) && slots.bitCheck(found); ++found) { }
+    double scanSeconds = __elapsed_seconds(start);
+    assert(found == TOTAL_BIT_COUT - 100);
+
+    printf("Benchmark_BitField_Find 10^7 bits \t\t| findFirstClear %.1f us | count %.1f us | bitCheck scan %.1f us |\n",
+        findSeconds * 1e6, countSeconds * 1e6, scanSeconds * 1e6);
+}
+
+void Benchmark_HierarchicalBitField()
+{
+    static const uint32_t TOTAL_BIT_COUT = 10000000;
+    static const uint32_t loops = 100;
+
+    // Release a slot near the end of a full map and take it back.
+    TinyHierarchicalBitField slots(TOTAL_BIT_COUT);
+    BitField flat(TOTAL_BIT_COUT);
+    flat.not();
+    for (uint32_t i = 0; i < TOTAL_BIT_COUT; ++i) { slots.allocate(); }
+
+    uint32_t found = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i)
+    {
+        slots.release(TOTAL_BIT_COUT - 100 - i);
+        found = slots.allocate();
+    }
+    double hierSeconds = __elapsed_seconds(start) / loops;
+    assert(found == TOTAL_BIT_COUT - 100 - (loops - 1));
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < loops; ++i)
+    {
+        flat.bitClr(TOTAL_BIT_COUT - 100 - i);
+        found = flat.findFirstClear();
+        flat.bitSet(found);
+    }
+    double flatSeconds = __elapsed_seconds(start) / loops;
+    assert(found == TOTAL_BIT_COUT - 100 - (loops - 1));
+
+    printf("Benchmark_HierarchicalBitField 10^7 bits \t| allocate %.3f us | flat findFirstClear %.1f us |\n",
+        hierSeconds * 1e6, flatSeconds * 1e6);
+}
+
+void Benchmark_CompressedBitField()
+{
+    static const uint32_t TOTAL_BIT_COUT = 100000000;
+    static const uint32_t loops = 5;
+    static const char* names[] = { "sparse 0.1%", "half", "ranges" };
+
+    srand((unsigned)time(NULL));
+
+    for (uint32_t mode = 0; mode < 3; ++mode)
+    {
+        CompressedBitField clhs(TOTAL_BIT_COUT), crhs(TOTAL_BIT_COUT);
+        BitField lhs(TOTAL_BIT_COUT), rhs(TOTAL_BIT_COUT);
+        __compressed_random(clhs, lhs, mode);
+        __compressed_random(crhs, rhs, mode);
+        clhs.optimize();
+        crhs.optimize();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < loops; ++i) { BitField result(lhs); result.and(rhs); result.or(rhs); }
+        double denseSeconds = __elapsed_seconds(start) / loops;
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < loops; ++i) { CompressedBitField result(clhs); result.and(crhs); result.or(crhs); }
+        double compressedSeconds = __elapsed_seconds(start) / loops;
+
+        printf("Benchmark_CompressedBitField %-11s \t| and+or dense %.2f ms %.1f MB | compressed %.2f ms %.1f MB |\n",
+            names[mode], denseSeconds * 1e3, TOTAL_BIT_COUT / 8 / 1e6, compressedSeconds * 1e3, clhs.memoryUsage() / 1e6);
+    }
+}
+
 int main()
 {
     Test_TinySmooth();
     printf("Test_TinySmooth \t\t\t\t\t| PASS |\n");
 
+    Test_TinyStatistics();
+    printf("Test_TinyStatistics \t\t\t\t\t| PASS |\n");
+
     Test_Ringbuffer();
     printf("Test_Ringbuffer \t\t\t\t\t| PASS |\n");
 
+    Test_CircularBuffer_Block();
+    printf("Test_CircularBuffer_Block \t\t\t\t| PASS |\n");
+
+    Test_CircularBuffer_Growable();
+    printf("Test_CircularBuffer_Growable \t\t\t\t| PASS |\n");
+
+    Test_MirroredCircularBuffer();
+    printf("Test_MirroredCircularBuffer \t\t\t\t| PASS |\n");
+
+    Test_RingBuffer_Span();
+    printf("Test_RingBuffer_Span \t\t\t\t\t| PASS |\n");
+
     Test_StringToIndex();
     printf("Test_StringToIndex \t\t\t\t\t| PASS |\n");
 
+    Test_StringIndex();
+    printf("Test_StringIndex \t\t\t\t\t| PASS |\n");
+
+    Test_StringIndex_Threads();
+    printf("Test_StringIndex_Threads \t\t\t\t| PASS |\n");
+
+    Test_StringTable();
+    printf("Test_StringTable \t\t\t\t\t| PASS |\n");
+
+    Test_StringQueue();
+    printf("Test_StringQueue \t\t\t\t\t| PASS |\n");
+
     Test_Ringbuffer_C();
     printf("Test_Ringbuffer_C \t\t\t\t\t| PASS |\n");
 
+    Test_Ringbuffer_C_Span();
+    printf("Test_Ringbuffer_C_Span \t\t\t\t\t| PASS |\n");
+
+    Test_BitField_Logic();
+    printf("Test_BitField_Logic \t\t\t\t\t| PASS |\n");
+
+    Test_BitField_Expression();
+    printf("Test_BitField_Expression \t\t\t\t| PASS |\n");
+
+    Test_BitField_Parallel();
+    printf("Test_BitField_Parallel \t\t\t\t\t| PASS |\n");
+
+    Test_BitField_Find();
+    printf("Test_BitField_Find \t\t\t\t\t| PASS |\n");
+
     Test_BitField_SetClr();
     printf("Test_BitField \t\t\t\t\t\t| PASS |\n");
 
-    printf("Test of TinyFamily \t\t\t\t\t| ALL PASSED |");
+    Test_HierarchicalBitField();
+    printf("Test_HierarchicalBitField \t\t\t\t| PASS |\n");
+
+    Test_CompressedBitField();
+    printf("Test_CompressedBitField \t\t\t\t| PASS |\n");
+
+    Test_AtomicBitField();
+    printf("Test_AtomicBitField \t\t\t\t\t| PASS |\n");
+
+#if defined(TINY_LARGE_CAPACITY)
+    Test_LargeCapacity();
+    printf("Test_LargeCapacity \t\t\t\t\t| PASS |\n");
+#endif
+
+    Test_SpscRingBuffer();
+    printf("Test_SpscRingBuffer \t\t\t\t\t| PASS |\n");
+
+    Test_MpmcRingBuffer();
+    printf("Test_MpmcRingBuffer \t\t\t\t\t| PASS |\n");
+
+    Test_RingPolicy();
+    printf("Test_RingPolicy \t\t\t\t\t| PASS |\n");
+
+    Test_FileMapping();
+    printf("Test_FileMapping \t\t\t\t\t| PASS |\n");
+
+    Test_SharedRingBuffer();
+    printf("Test_SharedRingBuffer \t\t\t\t\t| PASS |\n");
+
+    printf("Test of TinyFamily \t\t\t\t\t| ALL PASSED |\n");
+
+    Benchmark_SpscRingBuffer();
+    Benchmark_MpmcRingBuffer();
+    Benchmark_SharedRingBuffer();
+    Benchmark_CircularBuffer();
+    Benchmark_MirroredCircularBuffer();
+    Benchmark_Ringbuffer_C();
+    Benchmark_RingBufferIndex();
+    Benchmark_StringQueue();
+    Benchmark_StringIndex();
+    Benchmark_BitField();
+    Benchmark_BitField_Expression();
+    Benchmark_BitField_Parallel();
+    Benchmark_BitField_Find();
+    Benchmark_HierarchicalBitField();
+    Benchmark_CompressedBitField();
 
     return 0;
 }
\ No newline at end of file